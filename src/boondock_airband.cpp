@@ -56,6 +56,7 @@
 #include <ctime>
 #include <iostream>
 #include <libconfig.h++>
+#include <new>  // placement new
 #include "input-common.h"
 #include "logging.h"
 #include "boondock_airband.h"
@@ -74,6 +75,7 @@ int device_count, mixer_count;
 static int devices_running = 0;
 int tui = 0;  // do not display textual user interface
 int shout_metadata_delay = 3;
+int encoder_cpu_budget = DEFAULT_ENCODER_CPU_BUDGET;
 volatile int do_exit = 0;
 bool use_localtime = false;
 bool multiple_demod_threads = false;
@@ -98,6 +100,10 @@ void sighandler(int sig) {
     do_exit = 1;
 }
 
+void replay_sighandler(int) {
+    replay_dump_requested = 1;
+}
+
 void* controller_thread(void* params) {
     device_t* dev = (device_t*)params;
     int i = 0;
@@ -266,12 +272,30 @@ void init_demod(demod_params_t* params, Signal* signal, int device_start, int de
 }
 
 bool init_output(channel_t* channel, output_t* output) {
+    if (output->type == O_REPLAY) {
+        // A replay output has an encoder of its own rather than keeping the frames of another output
+        // of the channel: those may not be there, stop with a lost Icecast connection or between
+        // recorded transmissions, and have no fixed bitrate to size the ring for. Its bitrate is
+        // the VBR ceiling instead, so that the ring holds the whole duration even on busy channels.
+        output->preset.min_bitrate = 0;
+        output->preset.max_bitrate = output->preset.bitrate;
+    }
     if (output->has_mp3_output) {
-        output->lame = airlame_init(channel->mode, channel->highpass, channel->lowpass);
-        output->lamebuf = (unsigned char*)malloc(sizeof(unsigned char) * LAMEBUF_SIZE);
+        output->lame = airlame_init(channel->mode, channel->highpass, channel->lowpass, output->preset);
+        output->active_preset = output->preset;  // before the output threads start, no locking needed
+        if (output->lamebuf == NULL) {  // device outputs get theirs from the device arena
+            output->lamebuf = (unsigned char*)malloc(sizeof(unsigned char) * LAMEBUF_SIZE);
+        }
+    }
+    if (output->type == O_FILE && ((file_data*)(output->data))->append) {
+        gap_frames_init(channel->mode);
     }
     if (output->type == O_ICECAST) {
         shout_setup((icecast_data*)(output->data), channel->mode);
+    } else if (output->type == O_REPLAY) {
+        if (!replay_init((replay_data*)(output->data), output->preset.max_bitrate)) {
+            return false;
+        }
     } else if (output->type == O_UDP_STREAM) {
         udp_stream_data* sdata = (udp_stream_data*)(output->data);
         if (!udp_stream_init(sdata, channel->mode, (size_t)WAVE_BATCH * sizeof(float))) {
@@ -287,6 +311,81 @@ bool init_output(channel_t* channel, output_t* output) {
     return true;
 }
 
+// Lay out the DSP state of a device in its arena in processing order: FFT bin indexes and channels,
+// which the demodulator goes through for every FFT, then the frequency lists with the squelch and
+// filter state of each channel, then the encoder buffers and mixer input buffers of the outputs.
+// While the arena is being measured this only adds up sizes, afterwards it moves the state over
+// from the allocations made while parsing the config.
+static void layout_device_arena(device_t* dev, DspArena* arena) {
+    const bool move = arena->committed();
+
+    size_t* bins = arena->take_array<size_t>(dev->channel_count);
+    size_t* base_bins = arena->take_array<size_t>(dev->channel_count);
+    channel_t* channels = arena->take_array<channel_t>(dev->channel_count);
+    if (move) {
+        memcpy(bins, dev->bins, dev->channel_count * sizeof(size_t));
+        memcpy(base_bins, dev->base_bins, dev->channel_count * sizeof(size_t));
+        memcpy(channels, dev->channels, dev->channel_count * sizeof(channel_t));
+        free(dev->bins);
+        free(dev->base_bins);
+        free(dev->channels);
+        dev->bins = bins;
+        dev->base_bins = base_bins;
+        dev->channels = channels;
+    }
+
+    for (int j = 0; j < dev->channel_count; j++) {
+        channel_t* channel = dev->channels + j;
+        freq_t* freqlist = arena->take_array<freq_t>(channel->freq_count);
+        if (move) {
+            for (int f = 0; f < channel->freq_count; f++) {
+                new (freqlist + f) freq_t(channel->freqlist[f]);
+            }
+            free(channel->freqlist);
+            channel->freqlist = freqlist;
+        }
+    }
+
+    for (int j = 0; j < dev->channel_count; j++) {
+        channel_t* channel = dev->channels + j;
+        for (int k = 0; k < channel->output_count; k++) {
+            output_t* output = channel->outputs + k;
+            if (output->has_mp3_output) {
+                unsigned char* lamebuf = arena->take_array<unsigned char>(LAMEBUF_SIZE);
+                if (move) {
+                    output->lamebuf = lamebuf;
+                }
+            }
+            if (output->type == O_MIXER) {
+                mixer_data* mdata = (mixer_data*)(output->data);
+                mixinput_t* input = mdata->mixer->inputs + mdata->input;
+                const size_t wavein_len = WAVE_LEN;
+                float* wavein = arena->take_array<float>(wavein_len);
+                if (move) {
+                    memcpy(wavein, input->wavein, wavein_len * sizeof(float));
+                    free(input->wavein);
+                    input->wavein = wavein;
+                }
+            }
+        }
+    }
+}
+
+void init_device_arena(int devidx, device_t* dev) {
+    dev->arena = new DspArena;
+    layout_device_arena(dev, dev->arena);
+    if (!dev->arena->commit()) {
+        cerr << "Failed to allocate " << dev->arena->size() << " bytes of DSP state for device " << devidx << " - aborting\n";
+        error();
+    }
+    layout_device_arena(dev, dev->arena);
+    if (dev->arena->used() != dev->arena->size() || !dev->arena->contains(dev->channels)) {
+        cerr << "DSP state of device " << devidx << " does not match its arena layout - aborting\n";
+        error();
+    }
+    log(LOG_INFO, "Device #%d: DSP state of %d channel(s) in a %zu byte arena\n", devidx, dev->channel_count, dev->arena->size());
+}
+
 void init_output_params(output_params_t* params, int device_start, int device_end, int mixer_start, int mixer_end) {
     assert(params != NULL);
 
@@ -397,6 +496,7 @@ void* demodulate(void* params) {
         else
             available = dev->input->buf_size - dev->input->bufs + dev->input->bufe;
         pthread_mutex_unlock(&dev->input->buffer_lock);
+        atomic_max(&dev->max_input_backlog, available);
 
         if (devices_running == 0) {
             log(LOG_ERR, "All receivers failed, exiting\n");
@@ -520,6 +620,10 @@ void* demodulate(void* params) {
                 AFC afc(dev, i);
                 channel_t* channel = dev->channels + i;
                 freq_t* fparms = channel->freqlist + channel->freq_idx;
+                if (i + 1 < dev->channel_count) {
+                    // the next channel's squelch and filter state follows this one in the device arena
+                    __builtin_prefetch(dev->channels[i + 1].freqlist + dev->channels[i + 1].freq_idx);
+                }
 
                 // set to NO_SIGNAL, will be updated to SIGNAL based on squelch below
                 channel->axcindicate = NO_SIGNAL;
@@ -870,6 +974,12 @@ int main(int argc, char* argv[]) {
             cerr << "Configuration error: shout_metadata_delay is out of allowed range (0-" << 2 * TAG_QUEUE_LEN << ")\n";
             error();
         }
+        if (root.exists("encoder_cpu_budget"))
+            encoder_cpu_budget = (int)(root["encoder_cpu_budget"]);
+        if (encoder_cpu_budget < 0 || encoder_cpu_budget > 100) {
+            cerr << "Configuration error: encoder_cpu_budget is out of allowed range (0-100)\n";
+            error();
+        }
         if (root.exists("localtime") && (bool)root["localtime"] == true)
             use_localtime = true;
         if (root.exists("multiple_demod_threads") && (bool)root["multiple_demod_threads"] == true) {
@@ -887,6 +997,8 @@ int main(int argc, char* argv[]) {
             log_scan_activity = true;
         if (root.exists("stats_filepath"))
             stats_filepath = strdup(root["stats_filepath"]);
+        if (root.exists("replay_socket"))
+            replay_socket_path = strdup(root["replay_socket"]);
 #ifdef NFM
         if (root.exists("tau"))
             alpha = ((int)root["tau"] == 0 ? 0.0f : exp(-1.0f / (WAVE_RATE * 1e-6 * (int)root["tau"])));
@@ -899,13 +1011,17 @@ int main(int argc, char* argv[]) {
             error();
         }
 
-        struct sigaction sigact, pipeact;
+        struct sigaction sigact, pipeact, replayact;
 
         memset(&sigact, 0, sizeof(sigact));
         memset(&pipeact, 0, sizeof(pipeact));
+        memset(&replayact, 0, sizeof(replayact));
         pipeact.sa_handler = SIG_IGN;
         sigact.sa_handler = &sighandler;
+        replayact.sa_handler = &replay_sighandler;
+        replayact.sa_flags = SA_RESTART;
         sigaction(SIGPIPE, &pipeact, NULL);
+        sigaction(SIGUSR1, &replayact, NULL);
         sigaction(SIGHUP, &sigact, NULL);
         sigaction(SIGINT, &sigact, NULL);
         sigaction(SIGQUIT, &sigact, NULL);
@@ -1023,6 +1139,7 @@ int main(int argc, char* argv[]) {
     }
     for (int i = 0; i < device_count; i++) {
         device_t* dev = devices + i;
+        init_device_arena(i, dev);
         for (int j = 0; j < dev->channel_count; j++) {
             channel_t* channel = dev->channels + j;
 
@@ -1136,6 +1253,13 @@ int main(int argc, char* argv[]) {
         pthread_create(&mixer, NULL, &mixer_thread, output_params[output_thread_count - 1].mp3_signal);
     }
 
+    // Startup the replay thread (if there are any replay outputs)
+    THREAD replay;
+    bool replay_running = replay_enabled();
+    if (replay_running) {
+        pthread_create(&replay, NULL, &replay_thread, NULL);
+    }
+
 #ifdef WITH_PULSEAUDIO
     pulse_start();
 #endif /* WITH_PULSEAUDIO */
@@ -1166,6 +1290,9 @@ int main(int argc, char* argv[]) {
     }
     log(LOG_INFO, "Input threads closed\n");
 
+    // let any pending append gaps reach the disk before the files are closed and renamed
+    gap_writer_stop();
+
     for (int i = 0; i < device_count; i++) {
         device_t* dev = devices + i;
         disable_device_outputs(dev);
@@ -1182,6 +1309,11 @@ int main(int argc, char* argv[]) {
         pthread_join(output_threads[i], NULL);
     }
 
+    if (replay_running) {
+        log(LOG_INFO, "Closing replay thread\n");
+        pthread_join(replay, NULL);
+    }
+
     for (int i = 0; i < device_count; i++) {
         device_t* dev = devices + i;
         for (int j = 0; j < dev->channel_count; j++) {
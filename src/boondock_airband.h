@@ -44,9 +44,11 @@
 #include <pulse/stream.h>
 #endif /* WITH_PULSEAUDIO */
 
+#include "dsp_arena.h"
 #include "filters.h"
 #include "input-common.h"  // input_t
 #include "logging.h"
+#include "replay_buffer.h"
 #include "squelch.h"
 
 #define ALIGNED32 __attribute__((aligned(32)))
@@ -70,9 +72,9 @@
 #define WAVE_RATE 8000
 #endif /* NFM */
 
-#define WAVE_BATCH WAVE_RATE / 8
+#define WAVE_BATCH (WAVE_RATE / 8)
 #define AGC_EXTRA 100
-#define WAVE_LEN 2 * WAVE_BATCH + AGC_EXTRA
+#define WAVE_LEN (2 * WAVE_BATCH + AGC_EXTRA)
 #define MP3_RATE 8000
 #define MAX_SHOUT_QUEUELEN 32768
 #define TAG_QUEUE_LEN 16
@@ -82,6 +84,8 @@
 #define MAX_FFT_SIZE_LOG 13
 
 #define LAMEBUF_SIZE 22000  // todo: calculate
+#define DEFAULT_ENCODER_CPU_BUDGET 75  // percent of one CPU core the encoders of an output thread may use
+#define DEFAULT_REPLAY_DURATION 300
 #define MIX_DIVISOR 2
 
 #ifdef WITH_BCM_VC
@@ -106,7 +110,8 @@ enum output_type {
     O_FILE,
     O_RAWFILE,
     O_MIXER,
-    O_UDP_STREAM
+    O_UDP_STREAM,
+    O_REPLAY
 #ifdef WITH_PULSEAUDIO
     ,
     O_PULSE
@@ -159,6 +164,16 @@ struct udp_stream_data {
     socklen_t dest_sockaddr_len;
 };
 
+struct replay_data {
+    const char* name;
+    const char* directory;       // where to save the buffer on SIGUSR1, NULL to disable
+    int duration;                // seconds of audio to keep
+    bool continuous;             // keep silence between transmissions too
+    bool in_transmission;        // squelch was open during the previous batch
+    bool transmission_starting;  // squelch opened, but the encoder has not produced any data yet
+    ReplayBuffer* buffer;
+};
+
 #ifdef WITH_PULSEAUDIO
 struct pulse_data {
     const char* server;
@@ -178,6 +193,15 @@ struct mixer_data {
     int input;
 };
 
+// LAME settings of an mp3 output
+struct encoder_preset {
+    bool vbr;         // VBR, or CBR when false
+    int bitrate;      // kbps
+    int quality;      // LAME algorithm quality, 0 (best, slowest) to 9 (worst, fastest)
+    int min_bitrate;  // kbps, the minimum bitrate with VBR, 0 for no limit
+    int max_bitrate;  // kbps, the maximum bitrate with VBR, 0 for no limit
+};
+
 struct output_t {
     enum output_type type;
     bool enabled;
@@ -192,6 +216,17 @@ struct output_t {
     // if `uses_mp3_output` is true
     lame_t lame;
     unsigned char* lamebuf;
+
+    // encoder settings, the quality may be lowered at runtime to stay within encoder_cpu_budget
+    encoder_preset preset;         // the settings to use, owned by the output thread
+    encoder_preset active_preset;  // the settings `lame` was created with, under active_preset_lock once running
+    bool preset_changed;           // re-create `lame` with `preset` before encoding the next batch
+    double encode_cpu_time;        // CPU time spent encoding since the last budget check
+    size_t encoded_batches;        // batches encoded since the last budget check
+    double encode_cpu_per_batch;   // average over the previous budget check interval, read with atomic_read()
+
+    // longest time spent handling one batch for this output since the last stats file write
+    double max_write_time;
 };
 
 struct freq_tag {
@@ -230,15 +265,15 @@ class Signal {
 };
 
 struct freq_t {
-    int frequency;     // scan frequency
-    char* label;       // frequency label
-    float agcavgfast;  // average power, for AGC
-    float ampfactor;   // multiplier to increase / decrease volume
-    Squelch squelch;
+    int frequency;                 // scan frequency
+    char* label;                   // frequency label
+    float agcavgfast;              // average power, for AGC
+    float ampfactor;               // multiplier to increase / decrease volume
     size_t active_counter;         // count of loops where channel has signal
     NotchFilter notch_filter;      // notch filter - good to remove CTCSS tones
     LowpassFilter lowpass_filter;  // lowpass filter, applied to I/Q after derotation, set at bandwidth/2 to remove out of band noise
     enum modulations modulation;
+    Squelch squelch;  // last, so that its CTCSS detectors at the end don't separate the state used for every sample
 };
 struct channel_t {
     float wavein[WAVE_LEN];      // FFT output waveform
@@ -289,6 +324,8 @@ struct device_t {
     int failed;
     enum rec_modes mode;
     size_t output_overrun_count;
+    size_t max_input_backlog;  // most input bytes waiting for the demodulator since the last stats file write
+    DspArena* arena;           // holds bins, channels, frequency lists and output buffers once outputs are initialized
 };
 
 struct mixinput_t {
@@ -337,7 +374,10 @@ struct output_params_t {
 extern char const* BOONDOCK_AIRBAND_VERSION;
 
 // output.cpp
-lame_t airlame_init(mix_modes mixmode, int highpass, int lowpass);
+extern const encoder_preset default_encoder_preset;
+lame_t airlame_init(mix_modes mixmode, int highpass, int lowpass, const encoder_preset& preset);
+void gap_frames_init(mix_modes mixmode);
+void gap_writer_stop();
 void shout_setup(icecast_data* icecast, mix_modes mixmode);
 void disable_device_outputs(device_t* dev);
 void disable_channel_outputs(channel_t* channel);
@@ -352,6 +392,7 @@ extern char* stats_filepath;
 extern size_t fft_size, fft_size_log;
 extern int device_count, mixer_count;
 extern int shout_metadata_delay;
+extern int encoder_cpu_budget;
 extern volatile int do_exit, device_opened;
 extern float alpha;
 extern device_t* devices;
@@ -361,6 +402,36 @@ extern mixer_t* mixers;
 int atomic_inc(volatile int* pv);
 int atomic_dec(volatile int* pv);
 int atomic_get(volatile int* pv);
+
+// Relaxed atomic access to plain fields of the calloc()ed config structs, which are
+// updated by one thread and read (and reset) by the thread writing the stats file
+template <typename T>
+inline T atomic_read(T* p) {
+    T value;
+    __atomic_load(p, &value, __ATOMIC_RELAXED);
+    return value;
+}
+
+template <typename T>
+inline void atomic_write(T* p, T value) {
+    __atomic_store(p, &value, __ATOMIC_RELAXED);
+}
+
+// return the value and reset it to zero
+template <typename T>
+inline T atomic_take(T* p) {
+    T zero = T(), value;
+    __atomic_exchange(p, &zero, &value, __ATOMIC_RELAXED);
+    return value;
+}
+
+template <typename T>
+inline void atomic_max(T* p, T value) {
+    T current = atomic_read(p);
+    while (value > current && !__atomic_compare_exchange(p, &current, &value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
 double atofs(char* s);
 double delta_sec(const timeval* start, const timeval* stop);
 void log(int priority, const char* format, ...);
@@ -394,6 +465,14 @@ void udp_stream_write(udp_stream_data* sdata, const float* data, size_t len);
 void udp_stream_write(udp_stream_data* sdata, const float* data_left, const float* data_right, size_t len);
 void udp_stream_shutdown(udp_stream_data* sdata);
 
+// replay.cpp
+extern char* replay_socket_path;
+extern volatile int replay_dump_requested;
+bool replay_init(replay_data* rdata, int max_bitrate);
+void replay_put(replay_data* rdata, const unsigned char* data, size_t len, bool has_signal);
+bool replay_enabled();
+void* replay_thread(void* params);
+
 #ifdef WITH_PULSEAUDIO
 #define PULSE_STREAM_LATENCY_LIMIT 10000000UL
 // pulse.cpp
@@ -21,16 +21,54 @@
 #include <assert.h>
 #include <stdint.h>  // uint32_t
 #include <syslog.h>
+#include <algorithm>  // std::find()
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <iterator>  // std::begin(), std::end()
 #include <libconfig.h++>
 #include "input-common.h"  // input_t
 #include "boondock_airband.h"
 
 using namespace std;
 
+static void parse_encoder_preset(libconfig::Setting& out, output_t* output, int i, int j, int o, bool parsing_mixers) {
+    // bitrates of MPEG 2.5 layer III up to what makes sense at MP3_RATE
+    static const int bitrates[] = {8, 16, 24, 32, 40, 48, 56, 64};
+
+    output->preset = default_encoder_preset;
+    if (out.exists("vbr")) {
+        output->preset.vbr = (bool)out["vbr"];
+    }
+    if (out.exists("bitrate")) {
+        output->preset.bitrate = (int)out["bitrate"];
+        if (std::find(std::begin(bitrates), std::end(bitrates), output->preset.bitrate) == std::end(bitrates)) {
+            if (parsing_mixers) {
+                cerr << "Configuration error: mixers.[" << i << "] outputs.[" << o << "]: ";
+            } else {
+                cerr << "Configuration error: devices.[" << i << "] channels.[" << j << "] outputs.[" << o << "]: ";
+            }
+            cerr << "invalid bitrate; must be one of: 8, 16, 24, 32, 40, 48, 56, 64\n";
+            error();
+        }
+        // a configured bitrate is the VBR floor, as with lame -b, the default leaves VBR unlimited
+        output->preset.min_bitrate = output->preset.bitrate;
+    }
+    if (out.exists("quality")) {
+        output->preset.quality = (int)out["quality"];
+        if (output->preset.quality < 0 || output->preset.quality > 9) {
+            if (parsing_mixers) {
+                cerr << "Configuration error: mixers.[" << i << "] outputs.[" << o << "]: ";
+            } else {
+                cerr << "Configuration error: devices.[" << i << "] channels.[" << j << "] outputs.[" << o << "]: ";
+            }
+            cerr << "quality must be between 0 (best) and 9 (fastest)\n";
+            error();
+        }
+    }
+}
+
 static int parse_outputs(libconfig::Setting& outs, channel_t* channel, int i, int j, bool parsing_mixers) {
     int oo = 0;
     for (int o = 0; o < channel->output_count; o++) {
@@ -192,6 +230,41 @@ static int parse_outputs(libconfig::Setting& outs, channel_t* channel, int i, in
                 error();
             }
             debug_print("dev[%d].chan[%d].out[%d] connected to mixer %s as input %d (ampfactor=%.1f balance=%.1f)\n", i, j, o, name, mdata->input, ampfactor, balance);
+        } else if (!strncmp(outs[o]["type"], "replay", 6)) {
+            channel->outputs[oo].data = XCALLOC(1, sizeof(struct replay_data));
+            channel->outputs[oo].type = O_REPLAY;
+            replay_data* rdata = (replay_data*)(channel->outputs[oo].data);
+
+            rdata->continuous = outs[o].exists("continuous") ? (bool)(outs[o]["continuous"]) : false;
+            rdata->duration = outs[o].exists("duration") ? (int)(outs[o]["duration"]) : DEFAULT_REPLAY_DURATION;
+            rdata->directory = outs[o].exists("directory") ? strdup(outs[o]["directory"]) : NULL;
+            if (rdata->duration < 1) {
+                if (parsing_mixers) {
+                    cerr << "Configuration error: mixers.[" << i << "] outputs.[" << o << "]: ";
+                } else {
+                    cerr << "Configuration error: devices.[" << i << "] channels.[" << j << "] outputs.[" << o << "]: ";
+                }
+                cerr << "replay duration must be greater than 0\n";
+                error();
+            }
+
+            if (outs[o].exists("name")) {
+                rdata->name = strdup(outs[o]["name"]);
+            } else {
+                if (parsing_mixers) {
+                    cerr << "Configuration error: mixers.[" << i << "] outputs.[" << o << "]: replay outputs of mixers must have name defined\n";
+                    error();
+                }
+                if (channel->freqlist[0].label != NULL) {
+                    rdata->name = strdup(channel->freqlist[0].label);
+                } else {
+                    char buf[32];
+                    snprintf(buf, sizeof(buf), "%.3f", (float)channel->freqlist[0].frequency / 1000000.0f);
+                    rdata->name = strdup(buf);
+                }
+            }
+
+            channel->outputs[oo].has_mp3_output = true;
         } else if (!strncmp(outs[o]["type"], "udp_stream", 6)) {
             channel->outputs[oo].data = XCALLOC(1, sizeof(struct udp_stream_data));
             channel->outputs[oo].type = O_UDP_STREAM;
@@ -261,6 +334,9 @@ static int parse_outputs(libconfig::Setting& outs, channel_t* channel, int i, in
             cerr << "unknown output type\n";
             error();
         }
+        if (channel->outputs[oo].has_mp3_output) {
+            parse_encoder_preset(outs[o], &channel->outputs[oo], i, j, o, parsing_mixers);
+        }
         channel->outputs[oo].enabled = true;
         channel->outputs[oo].active = false;
         oo++;
@@ -805,6 +881,7 @@ int parse_devices(libconfig::Setting& devs) {
         dev->input->bufs = dev->input->bufe = 0;
         dev->input->overflow_count = 0;
         dev->output_overrun_count = 0;
+        dev->max_input_backlog = 0;
         dev->waveend = dev->waveavail = dev->row = dev->tq_head = dev->tq_tail = 0;
         dev->last_frequency = -1;
 
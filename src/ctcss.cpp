@@ -61,46 +61,49 @@ void ToneDetector::reset(void) {
 bool ToneDetectorSet::add(const float& tone_freq, const float& sample_rate, int window_size) {
     ToneDetector new_tone = ToneDetector(tone_freq, sample_rate, window_size);
 
-    for (const auto tone : tones_) {
-        if (new_tone.coefficient() == tone.coefficient()) {
+    for (int i = 0; i < tone_count_; ++i) {
+        if (new_tone.coefficient() == tones_[i].coefficient()) {
             debug_print("Skipping tone %f, too close to other tones\n", tone_freq);
             return false;
         }
     }
 
-    tones_.push_back(new_tone);
+    if (tone_count_ >= MAX_TONES) {
+        debug_print("Skipping tone %f, no room for more than %d tones\n", tone_freq, MAX_TONES);
+        return false;
+    }
+    tones_[tone_count_++] = new_tone;
     return true;
 }
 
 void ToneDetectorSet::process_sample(const float& sample) {
-    for (vector<ToneDetector>::iterator it = tones_.begin(); it != tones_.end(); ++it) {
-        it->process_sample(sample);
+    for (int i = 0; i < tone_count_; ++i) {
+        tones_[i].process_sample(sample);
     }
 }
 
 void ToneDetectorSet::reset(void) {
-    for (vector<ToneDetector>::iterator it = tones_.begin(); it != tones_.end(); ++it) {
-        it->reset();
+    for (int i = 0; i < tone_count_; ++i) {
+        tones_[i].reset();
     }
 }
 
-float ToneDetectorSet::sorted_powers(vector<ToneDetectorSet::PowerIndex>& powers) {
-    powers.clear();
-
+float ToneDetectorSet::sorted_powers(ToneDetectorSet::PowerIndex* powers) {
     float total_power = 0.0;
-    for (size_t i = 0; i < tones_.size(); ++i) {
-        powers.push_back({tones_[i].relative_power(), tones_[i].freq()});
+    for (int i = 0; i < tone_count_; ++i) {
+        powers[i] = {tones_[i].relative_power(), tones_[i].freq()};
         total_power += tones_[i].relative_power();
     }
 
-    sort(powers.begin(), powers.end(), [](PowerIndex a, PowerIndex b) { return a.power > b.power; });
+    sort(powers, powers + tone_count_, [](PowerIndex a, PowerIndex b) { return a.power > b.power; });
 
-    return total_power / tones_.size();
+    return total_power / tone_count_;
 }
 
-vector<float> CTCSS::standard_tones = {67.0,  69.3,  71.9,  74.4,  77.0,  79.7,  82.5,  85.4,  88.5,  91.5,  94.8,  97.4,  100.0, 103.5, 107.2, 110.9, 114.8,
-                                       118.8, 123.0, 127.3, 131.8, 136.5, 141.3, 146.2, 150.0, 151.4, 156.7, 159.8, 162.2, 165.5, 167.9, 171.3, 173.8, 177.3,
-                                       179.9, 183.5, 186.2, 189.9, 192.8, 196.6, 199.5, 203.5, 206.5, 210.7, 218.1, 225.7, 229.1, 233.6, 241.8, 250.3, 254.1};
+const int ToneDetectorSet::MAX_TONES;
+constexpr float CTCSS::standard_tones[];
+
+static_assert(sizeof(CTCSS::standard_tones) / sizeof(CTCSS::standard_tones[0]) + 1 == ToneDetectorSet::MAX_TONES, "ToneDetectorSet::MAX_TONES must fit every standard tone");
 
 CTCSS::CTCSS(const float& ctcss_freq, const float& sample_rate, int window_size) : enabled_(true), ctcss_freq_(ctcss_freq), window_size_(window_size), found_count_(0), not_found_count_(0) {
     debug_print("Adding CTCSS detector for %f Hz with a sample rate of %f and window %d\n", ctcss_freq, sample_rate, window_size_);
@@ -138,12 +141,12 @@ void CTCSS::process_audio_sample(const float& sample) {
     // if this is sample fills out the window then check if one of the "strongest"
     // tones is the CTCSS tone we are looking for.  NOTE: there can be multiple "strongest"
     // tones based on floating point math
-    vector<ToneDetectorSet::PowerIndex> tone_powers;
+    ToneDetectorSet::PowerIndex tone_powers[ToneDetectorSet::MAX_TONES];
     float avg_power = powers_.sorted_powers(tone_powers);
     float ctcss_tone_power = 0.0;
-    for (const auto i : tone_powers) {
-        if (i.freq == ctcss_freq_) {
-            ctcss_tone_power = i.power;
+    for (int i = 0; i < powers_.size(); ++i) {
+        if (tone_powers[i].freq == ctcss_freq_) {
+            ctcss_tone_power = tone_powers[i].power;
             break;
         }
     }
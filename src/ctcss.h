@@ -21,10 +21,10 @@
 #define _CTCSS_H 1
 
 #include <cstddef>  // size_t
-#include <vector>
 
 class ToneDetector {
    public:
+    ToneDetector(void) : tone_freq_(0.0f), magnitude_(0.0f), window_size_(0), coeff_(0.0f), count_(0), q0_(0.0f), q1_(0.0f), q2_(0.0f) {}
     ToneDetector(float tone_freq, float sample_freq, int window_size);
     void process_sample(const float& sample);
     void reset(void);
@@ -53,16 +53,22 @@ class ToneDetectorSet {
         float freq;
     };
 
-    ToneDetectorSet() {}
+    // the CTCSS tone being detected plus all of CTCSS::standard_tones
+    static const int MAX_TONES = 52;
+
+    ToneDetectorSet() : tone_count_(0) {}
 
     bool add(const float& tone_freq, const float& sample_freq, int window_size);
     void process_sample(const float& sample);
     void reset(void);
 
-    float sorted_powers(std::vector<PowerIndex>& powers);
+    int size(void) const { return tone_count_; }
+    float sorted_powers(PowerIndex* powers);  // powers must hold size() entries
 
    private:
-    std::vector<ToneDetector> tones_;
+    // fixed size so that detectors live inside their Squelch without separate allocations
+    ToneDetector tones_[MAX_TONES];
+    int tone_count_;
 };
 
 class CTCSS {
@@ -79,7 +85,9 @@ class CTCSS {
     bool enough_samples(void) const { return enough_samples_; }
     bool has_tone(void) const { return !enabled_ || has_tone_; }
 
-    static std::vector<float> standard_tones;
+    static constexpr float standard_tones[] = {67.0,  69.3,  71.9,  74.4,  77.0,  79.7,  82.5,  85.4,  88.5,  91.5,  94.8,  97.4,  100.0, 103.5, 107.2, 110.9, 114.8,
+                                               118.8, 123.0, 127.3, 131.8, 136.5, 141.3, 146.2, 150.0, 151.4, 156.7, 159.8, 162.2, 165.5, 167.9, 171.3, 173.8, 177.3,
+                                               179.9, 183.5, 186.2, 189.9, 192.8, 196.6, 199.5, 203.5, 206.5, 210.7, 218.1, 225.7, 229.1, 233.6, 241.8, 250.3, 254.1};
 
    private:
     bool enabled_;
@@ -0,0 +1,70 @@
+/*
+ * dsp_arena.cpp
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>  // assert()
+#include <cstdlib>  // posix_memalign(), free()
+#include <cstring>  // memset()
+
+#include "dsp_arena.h"
+
+using namespace std;
+
+const size_t DspArena::ALIGNMENT;
+
+static size_t align_up(size_t size) {
+    return (size + DspArena::ALIGNMENT - 1) & ~(DspArena::ALIGNMENT - 1);
+}
+
+DspArena::DspArena(void) : base_(NULL), size_(0), used_(0) {}
+
+DspArena::~DspArena(void) {
+    free(base_);
+}
+
+void* DspArena::take(size_t size) {
+    size = align_up(size);
+    if (base_ == NULL) {
+        size_ += size;
+        return NULL;
+    }
+    // the second pass must ask for exactly what the first one measured
+    assert(used_ + size <= size_);
+    if (used_ + size > size_) {
+        return NULL;
+    }
+    void* ptr = base_ + used_;
+    used_ += size;
+    return ptr;
+}
+
+bool DspArena::commit(void) {
+    assert(base_ == NULL);
+    void* ptr;
+    if (posix_memalign(&ptr, ALIGNMENT, size_ > 0 ? size_ : ALIGNMENT) != 0) {
+        return false;
+    }
+    memset(ptr, 0, size_);
+    base_ = (unsigned char*)ptr;
+    return true;
+}
+
+bool DspArena::contains(const void* ptr) const {
+    const unsigned char* p = (const unsigned char*)ptr;
+    return base_ != NULL && p >= base_ && p < base_ + size_;
+}
@@ -0,0 +1,66 @@
+/*
+ * dsp_arena.h
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DSP_ARENA_H
+#define _DSP_ARENA_H
+
+#include <cstddef>  // size_t
+
+/*
+ One cache line aligned block of memory holding the DSP state of a device.
+
+ The arena is laid out in the order the state is processed, so that the demodulator walks through
+ memory in one direction instead of chasing separate heap allocations, and every piece starts on a
+ cache line of its own so that no two pieces written by different threads share one.
+
+ Sizes are only known once the configuration has been parsed, so an arena is filled in two passes over
+ the same sequence of take() calls: while measuring, take() only adds up the aligned sizes and returns
+ NULL. commit() then allocates the block and the second pass hands out consecutive, zeroed pieces of it.
+ */
+
+class DspArena {
+   public:
+    static const size_t ALIGNMENT = 64;  // cache line size
+
+    DspArena(void);
+    ~DspArena(void);
+
+    void* take(size_t size);
+    template <typename T>
+    T* take_array(size_t count) {
+        return static_cast<T*>(take(count * sizeof(T)));
+    }
+
+    bool commit(void);
+    bool committed(void) const { return base_ != NULL; }
+
+    size_t size(void) const { return size_; }
+    size_t used(void) const { return used_; }
+    bool contains(const void* ptr) const;
+
+   private:
+    DspArena(const DspArena&);
+    DspArena& operator=(const DspArena&);
+
+    unsigned char* base_;
+    size_t size_;  // bytes measured in the first pass
+    size_t used_;  // bytes handed out in the second pass
+};
+
+#endif /* _DSP_ARENA_H */
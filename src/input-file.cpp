@@ -25,6 +25,7 @@
 #include <string.h>
 #include <syslog.h>         // FIXME: get rid of this
 #include <unistd.h>         // usleep
+#include <algorithm>        // std::min
 #include <libconfig.h++>    // Setting
 #include "input-common.h"   // input_t, sample_format_t, input_state_t, MODULE_EXPORT
 #include "input-helpers.h"  // circbuffer_append
@@ -61,6 +62,10 @@ int file_parse_config(input_t* const input, libconfig::Setting& cfg) {
         dev_data->speedup_factor = 4;
     }
 
+    if (cfg.exists("loop")) {
+        dev_data->loop = (bool)cfg["loop"];
+    }
+
     return 0;
 }
 
@@ -89,18 +94,33 @@ void* file_rx_thread(void* ctx) {
     assert(dev_data->speedup_factor != 0.0);
 
     size_t buf_len = (input->buf_size / 2) - 1;
+    if (dev_data->loop) {
+        // A looped file stands in for a live receiver (e.g. in soak tests): read about 50 ms of samples at a
+        // time so that the demodulator gets a steady flow of data like from a dongle instead of bursts.
+        buf_len = std::min((size_t)(input->sample_rate * input->bytes_per_sample * 2 / 20), buf_len);
+    }
     unsigned char* buf = (unsigned char*)XCALLOC(1, buf_len);
 
-    float time_per_byte_ms = 1000 / (input->sample_rate * input->bytes_per_sample * 2 * dev_data->speedup_factor);
+    double time_per_byte_ms = 1000.0 / (input->sample_rate * input->bytes_per_sample * 2 * dev_data->speedup_factor);
 
     log(LOG_DEBUG, "sample_rate: %d, bytes_per_sample: %d, speedup_factor: %f, time_per_byte_ms: %f\n", input->sample_rate, input->bytes_per_sample, dev_data->speedup_factor, time_per_byte_ms);
 
     input->state = INPUT_RUNNING;
 
+    // looped files are paced against the start time rather than the previous read so that rounding errors
+    // don't accumulate over days of operation
+    timeval loop_start;
+    gettimeofday(&loop_start, NULL);
+    size_t total_len = 0;
+
     while (true) {
         if (do_exit) {
             break;
         }
+        if (feof(dev_data->input_file) && dev_data->loop) {
+            debug_print("File '%s': hit end of file, rewinding\n", dev_data->filepath);
+            rewind(dev_data->input_file);
+        }
         if (feof(dev_data->input_file)) {
             log(LOG_INFO, "File '%s': hit end of file at %d, disabling\n", dev_data->filepath, ftell(dev_data->input_file));
             input->state = INPUT_FAILED;
@@ -127,15 +147,22 @@ void* file_rx_thread(void* ctx) {
         if (space_left > buf_len) {
             size_t len = fread(buf, sizeof(unsigned char), buf_len, dev_data->input_file);
             circbuffer_append(input, buf, len);
+            total_len += len;
 
             timeval end;
             gettimeofday(&end, NULL);
 
-            int time_taken_ms = delta_sec(&start, &end) * 1000;
-            int sleep_time_ms = len * time_per_byte_ms - time_taken_ms;
-
-            if (sleep_time_ms > 0) {
-                SLEEP(sleep_time_ms);
+            if (dev_data->loop) {
+                double sleep_time_ms = total_len * time_per_byte_ms - delta_sec(&loop_start, &end) * 1000;
+                if (sleep_time_ms > 0) {
+                    usleep((useconds_t)(sleep_time_ms * 1000));
+                }
+            } else {
+                int time_taken_ms = delta_sec(&start, &end) * 1000;
+                int sleep_time_ms = len * time_per_byte_ms - time_taken_ms;
+                if (sleep_time_ms > 0) {
+                    SLEEP(sleep_time_ms);
+                }
             }
         } else {
             SLEEP(10);
@@ -163,6 +190,7 @@ MODULE_EXPORT input_t* file_input_new() {
     file_dev_data_t* dev_data = (file_dev_data_t*)XCALLOC(1, sizeof(file_dev_data_t));
     dev_data->input_file = NULL;
     dev_data->speedup_factor = 0.0;
+    dev_data->loop = false;
 
     input_t* input = (input_t*)XCALLOC(1, sizeof(input_t));
     input->dev_data = dev_data;
@@ -26,4 +26,5 @@ typedef struct {
     char* filepath;
     FILE* input_file;
     float speedup_factor;
+    bool loop;
 } file_dev_data_t;
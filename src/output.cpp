@@ -17,6 +17,7 @@
  * You should have received a copy of the GNU General Public License
  * along with this program; if not, see <https://www.gnu.org/licenses/>.
  */
+#include <fcntl.h>
 #include <math.h>
 #include <ogg/ogg.h>
 #include <shout/shout.h>
@@ -24,6 +25,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>  // pwritev()
 #include <unistd.h>
 #include <vorbis/vorbisenc.h>
 
@@ -39,7 +41,9 @@
 #include <pulse/pulseaudio.h>
 #endif /* WITH_PULSEAUDIO */
 
+#include <limits.h>  // IOV_MAX
 #include <syslog.h>
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstdlib>
@@ -47,6 +51,7 @@
 #include <ctime>
 #include <sstream>
 #include <string>
+#include <vector>
 #include "config.h"
 #include "helper_functions.h"
 #include "input-common.h"
@@ -144,7 +149,9 @@ void shout_setup(icecast_data* icecast, mix_modes mixmode) {
     }
 }
 
-lame_t airlame_init(mix_modes mixmode, int highpass, int lowpass) {
+const encoder_preset default_encoder_preset = {true, 16, 7, 0, 0};
+
+lame_t airlame_init(mix_modes mixmode, int highpass, int lowpass, const encoder_preset& preset) {
     lame_t lame = lame_init();
     if (!lame) {
         log(LOG_WARNING, "lame_init failed\n");
@@ -152,9 +159,16 @@ lame_t airlame_init(mix_modes mixmode, int highpass, int lowpass) {
     }
 
     lame_set_in_samplerate(lame, WAVE_RATE);
-    lame_set_VBR(lame, vbr_mtrh);
-    lame_set_brate(lame, 16);
-    lame_set_quality(lame, 7);
+    lame_set_VBR(lame, preset.vbr ? vbr_mtrh : vbr_off);
+    lame_set_brate(lame, preset.bitrate);
+    lame_set_quality(lame, preset.quality);
+    // lame_set_brate() alone does not limit VBR
+    if (preset.vbr && preset.min_bitrate > 0) {
+        lame_set_VBR_min_bitrate_kbps(lame, preset.min_bitrate);
+    }
+    if (preset.vbr && preset.max_bitrate > 0) {
+        lame_set_VBR_max_bitrate_kbps(lame, preset.max_bitrate);
+    }
     lame_set_lowpassfreq(lame, lowpass);
     lame_set_highpassfreq(lame, highpass);
     lame_set_out_samplerate(lame, MP3_RATE);
@@ -165,7 +179,7 @@ lame_t airlame_init(mix_modes mixmode, int highpass, int lowpass) {
         lame_set_num_channels(lame, 1);
         lame_set_mode(lame, MONO);
     }
-    debug_print("lame init with mixmode=%s\n", mixmode == MM_STEREO ? "MM_STEREO" : "MM_MONO");
+    debug_print("lame init with mixmode=%s %s %d kbps quality=%d\n", mixmode == MM_STEREO ? "MM_STEREO" : "MM_MONO", preset.vbr ? "VBR" : "CBR", preset.bitrate, preset.quality);
     lame_init_params(lame);
     return lame;
 }
@@ -191,7 +205,7 @@ class LameTone {
             }
         } else
             memset(buf, 0, samples * sizeof(float));
-        lame_t lame = airlame_init(mixmode, 0, 0);
+        lame_t lame = airlame_init(mixmode, 0, 0, default_encoder_preset);
         if (lame) {
             _bytes = lame_encode_buffer_ieee_float(lame, buf, (mixmode == MM_STEREO ? buf : NULL), samples, _data, LAMEBUF_SIZE);
             if (_bytes > 0) {
@@ -217,19 +231,210 @@ class LameTone {
             free(_data);
     }
 
-    int write(FILE* f) {
-        if (!_data || _bytes <= 0)
-            return 1;
+    const unsigned char* data() const { return _data; }
+    size_t bytes() const { return _bytes > 0 ? (size_t)_bytes : 0; }
+};
 
-        if (fwrite(_data, 1, _bytes, f) != (unsigned int)_bytes) {
-            log(LOG_WARNING, "LameTone: failed to write %d bytes\n", _bytes);
-            return -1;
-        }
+/*
+ * Discontinuity marker tones and one second of silence, pre-encoded once per
+ * mix mode at startup, so that reopening a file for append does not need
+ * to set up any LAME encoders on the output thread.
+ */
+struct gap_frames_t {
+    LameTone* markers[3];  // 2222 Hz, 1111 Hz, 555 Hz
+    LameTone* silence;     // one second
+};
 
-        return 0;
+static gap_frames_t gap_frames[MM_STEREO + 1];
+
+void gap_frames_init(mix_modes mixmode) {
+    gap_frames_t* gf = &gap_frames[mixmode];
+    if (gf->silence != NULL) {
+        return;
     }
+    gf->markers[0] = new LameTone(mixmode, 120, 2222);
+    gf->markers[1] = new LameTone(mixmode, 120, 1111);
+    gf->markers[2] = new LameTone(mixmode, 120, 555);
+    gf->silence = new LameTone(mixmode, 1000);
+}
+
+/*
+ * Gaps are written by a single writer thread, started with the first one, into space
+ * reserved at the end of the file, so that the output thread can carry on appending
+ * new audio right away. The gap is never assembled in memory: it is a list of iovecs
+ * pointing at the cached frames, so an hour of silence takes four pwritev() calls.
+ */
+struct gap_write_t {
+    int fd;
+    off_t offset;
+    size_t len;
+    mix_modes mixmode;
+    time_t silence_sec;
+    std::string path;
+    gap_write_t* next;
 };
 
+static pthread_mutex_t gap_writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gap_writer_cond = PTHREAD_COND_INITIALIZER;
+static gap_write_t* gap_queue_head = NULL;
+static gap_write_t* gap_queue_tail = NULL;
+static pthread_t gap_writer;
+static bool gap_writer_running = false;
+static bool gap_writer_stopping = false;
+
+static size_t gap_size(const gap_frames_t* gf, time_t silence_sec) {
+    size_t markers_len = 0;
+    for (int i = 0; i < 3; i++) {
+        markers_len += gf->markers[i]->bytes();
+    }
+    return 2 * markers_len + (size_t)silence_sec * gf->silence->bytes();
+}
+
+static void gap_add_frame(std::vector<iovec>* iov, const LameTone* frame) {
+    if (frame->bytes() > 0) {
+        iov->push_back({const_cast<unsigned char*>(frame->data()), frame->bytes()});  // only read by pwritev()
+    }
+}
+
+// Write the gap as one list of references to the cached frames, IOV_MAX of them per pwritev().
+static void gap_write(gap_write_t* gw) {
+    const gap_frames_t* gf = &gap_frames[gw->mixmode];
+    std::vector<iovec> iov;
+    iov.reserve(6 + (size_t)gw->silence_sec);
+    for (int i = 0; i < 3; i++) {
+        gap_add_frame(&iov, gf->markers[i]);
+    }
+    for (time_t s = 0; s < gw->silence_sec; s++) {
+        gap_add_frame(&iov, gf->silence);
+    }
+    for (int i = 2; i >= 0; i--) {
+        gap_add_frame(&iov, gf->markers[i]);
+    }
+
+    size_t done = 0;
+    size_t first = 0;
+    while (first < iov.size()) {
+        ssize_t ret = pwritev(gw->fd, &iov[first], (int)std::min(iov.size() - first, (size_t)IOV_MAX), gw->offset + (off_t)done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            // the output thread is already appending behind the gap, so the rest stays zero-filled
+            log(LOG_WARNING, "Failed to write gap filler to %s, bytes %llu-%llu are not valid MP3 (%s)\n", gw->path.c_str(), (unsigned long long)(gw->offset + (off_t)done),
+                (unsigned long long)(gw->offset + (off_t)gw->len), ret < 0 ? strerror(errno) : "short write");
+            break;
+        }
+        done += (size_t)ret;
+        // skip the frames written and move into a partially written one
+        while (ret > 0 && (size_t)ret >= iov[first].iov_len) {
+            ret -= iov[first].iov_len;
+            first++;
+        }
+        if (ret > 0) {
+            iov[first].iov_base = (unsigned char*)iov[first].iov_base + ret;
+            iov[first].iov_len -= ret;
+        }
+    }
+    close(gw->fd);
+    delete gw;
+}
+
+static void* gap_writer_thread(void*) {
+    pthread_mutex_lock(&gap_writer_lock);
+    while (true) {
+        while (gap_queue_head == NULL && !gap_writer_stopping) {
+            pthread_cond_wait(&gap_writer_cond, &gap_writer_lock);
+        }
+        gap_write_t* gw = gap_queue_head;
+        if (gw == NULL) {
+            break;  // stopping and nothing left to write
+        }
+        gap_queue_head = gw->next;
+        if (gap_queue_head == NULL) {
+            gap_queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&gap_writer_lock);
+        gap_write(gw);
+        pthread_mutex_lock(&gap_writer_lock);
+    }
+    pthread_mutex_unlock(&gap_writer_lock);
+    return NULL;
+}
+
+// Hand a gap over to the writer thread. Once it has been stopped the gap is written right away.
+static void gap_writer_queue(gap_write_t* gw) {
+    pthread_mutex_lock(&gap_writer_lock);
+    if (!gap_writer_running && !gap_writer_stopping) {
+        gap_writer_running = (pthread_create(&gap_writer, NULL, &gap_writer_thread, NULL) == 0);
+    }
+    if (!gap_writer_running) {
+        pthread_mutex_unlock(&gap_writer_lock);
+        gap_write(gw);
+        return;
+    }
+    gw->next = NULL;
+    if (gap_queue_tail != NULL) {
+        gap_queue_tail->next = gw;
+    } else {
+        gap_queue_head = gw;
+    }
+    gap_queue_tail = gw;
+    pthread_cond_signal(&gap_writer_cond);
+    pthread_mutex_unlock(&gap_writer_lock);
+}
+
+// Write out all queued gaps and wait for the writer thread to exit. Must be called before
+// the files are closed on shutdown, otherwise reserved space would be left zero-filled.
+void gap_writer_stop() {
+    pthread_mutex_lock(&gap_writer_lock);
+    bool running = gap_writer_running;
+    gap_writer_stopping = true;
+    gap_writer_running = false;
+    pthread_cond_signal(&gap_writer_cond);
+    pthread_mutex_unlock(&gap_writer_lock);
+    if (running) {
+        pthread_join(gap_writer, NULL);
+    }
+}
+
+/*
+ * Fill the gap at the end of an audio file being appended to with marker tones
+ * and (in continuous mode) silence_sec seconds of silence.
+ * The file is extended to make room for the gap and the writer thread fills it in.
+ */
+static void write_gap(file_data* fdata, mix_modes mixmode, off_t offset, time_t silence_sec) {
+    gap_frames_t* gf = &gap_frames[mixmode];
+    if (gf->silence == NULL) {
+        debug_print("gap frames not initialized for mixmode=%d\n", mixmode);
+        return;
+    }
+
+    size_t len = gap_size(gf, silence_sec);
+    if (len == 0) {
+        return;
+    }
+
+    // a separate descriptor is needed, as pwrite() ignores the offset on files opened with O_APPEND
+    int fd = open(fdata->file_path_tmp.c_str(), O_WRONLY);
+    if (fd < 0 || ftruncate(fileno(fdata->f), offset + (off_t)len) != 0) {
+        log(LOG_WARNING, "Cannot reserve %zu bytes of gap filler in %s (%s)\n", len, fdata->file_path_tmp.c_str(), strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    debug_print("Filling %zu bytes of gap (%ld sec of silence) at pos %llu of %s\n", len, (long)silence_sec, (unsigned long long)offset, fdata->file_path_tmp.c_str());
+
+    gap_write_t* gw = new gap_write_t;
+    gw->fd = fd;
+    gw->offset = offset;
+    gw->len = len;
+    gw->mixmode = mixmode;
+    gw->path = fdata->file_path;
+    gw->silence_sec = silence_sec;
+    gap_writer_queue(gw);
+}
+
 int rename_if_exists(char const* oldpath, char const* newpath) {
     int ret = rename(oldpath, newpath);
     if (ret < 0) {
@@ -272,18 +477,8 @@ static int open_file(file_data* fdata, mix_modes mixmode, int is_audio) {
     }
 
     if (is_audio) {
-        // fill missing space with marker tones
-        LameTone lt_a(mixmode, 120, 2222);
-        LameTone lt_b(mixmode, 120, 1111);
-        LameTone lt_c(mixmode, 120, 555);
-
-        int r = lt_a.write(fdata->f);
-        if (r == 0)
-            r = lt_b.write(fdata->f);
-        if (r == 0)
-            r = lt_c.write(fdata->f);
-
         // fill in time delta with silence if continuous output mode
+        time_t silence_sec = 0;
         if (fdata->continuous) {
             time_t now = time(NULL);
             if (now > st.st_mtime) {
@@ -292,21 +487,12 @@ static int open_file(file_data* fdata, mix_modes mixmode, int is_audio) {
                     log(LOG_WARNING, "Too big time difference: %llu sec, limiting to one hour\n", (unsigned long long)delta);
                     delta = 3600;
                 }
-                LameTone lt_silence(mixmode, 1000);
-                for (; (r == 0 && delta > 1); --delta)
-                    r = lt_silence.write(fdata->f);
+                silence_sec = delta - 1;
             }
         }
 
-        if (r == 0)
-            r = lt_c.write(fdata->f);
-        if (r == 0)
-            r = lt_b.write(fdata->f);
-        if (r == 0)
-            r = lt_a.write(fdata->f);
-
-        if (r < 0)
-            fseek(fdata->f, st.st_size, SEEK_SET);
+        // fill missing space with marker tones surrounding the silence
+        write_gap(fdata, mixmode, st.st_size, silence_sec);
     }
     return 0;
 }
@@ -393,6 +579,51 @@ static void close_if_necessary(output_t* output) {
     }
 }
 
+// guards active_preset of all outputs, which the thread writing the stats file reads
+static pthread_mutex_t active_preset_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Re-create the encoder of an output with its current preset. Whatever the old encoder still held is
+// flushed to the start of lamebuf, returns the number of bytes flushed.
+static int switch_encoder(channel_t* channel, output_t* output) {
+    output->preset_changed = false;
+    lame_t lame = airlame_init(channel->mode, channel->highpass, channel->lowpass, output->preset);
+    if (lame == NULL) {
+        return 0;  // keep going with the old one
+    }
+    int flushed = lame_encode_flush_nogap(output->lame, output->lamebuf, LAMEBUF_SIZE);
+    lame_close(output->lame);
+    output->lame = lame;
+
+    pthread_mutex_lock(&active_preset_lock);
+    output->active_preset = output->preset;
+    pthread_mutex_unlock(&active_preset_lock);
+    return flushed > 0 ? flushed : 0;
+}
+
+// Encode the current batch of a channel into the lamebuf of an output and account the CPU time used.
+// Streams switch to a changed preset right away, files only when the next file is opened (see
+// output_file_ready()) so that the lametag written on close describes the whole file.
+static int encode_batch(channel_t* channel, output_t* output) {
+    int flushed = 0;
+    if (output->preset_changed && output->type != O_FILE) {
+        flushed = switch_encoder(channel, output);
+    }
+
+    timespec start, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    int mp3_bytes = lame_encode_buffer_ieee_float(output->lame, channel->waveout, (channel->mode == MM_STEREO ? channel->waveout_r : NULL), WAVE_BATCH, output->lamebuf + flushed,
+                                                  LAMEBUF_SIZE - flushed);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    output->encode_cpu_time += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    output->encoded_batches++;
+
+    if (mp3_bytes < 0) {
+        log(LOG_WARNING, "lame_encode_buffer_ieee_float: %d\n", mp3_bytes);
+        return flushed > 0 ? flushed : mp3_bytes;
+    }
+    return flushed + mp3_bytes;
+}
+
 /*
  * For a particular channel file output, check if there is a file currently open.
  * If so, that file may need to be flushed and closed.
@@ -413,6 +644,10 @@ static bool output_file_ready(channel_t* channel, output_t* output) {
         return true;
     }
 
+    if (output->preset_changed && output->type == O_FILE) {
+        switch_encoder(channel, output);  // nothing to flush, close_file() already did
+    }
+
     timeval current_time;
     gettimeofday(&current_time, NULL);
     struct tm* time;
@@ -462,25 +697,33 @@ static bool output_file_ready(channel_t* channel, output_t* output) {
     return true;
 }
 
+// Raises max_write_time of an output to the time between construction and destruction
+struct output_write_timer {
+    output_t* output;
+    timeval start;
+
+    explicit output_write_timer(output_t* o) : output(o) { gettimeofday(&start, NULL); }
+    ~output_write_timer() {
+        timeval end;
+        gettimeofday(&end, NULL);
+        atomic_max(&output->max_write_time, delta_sec(&start, &end));
+    }
+};
+
 // Create all the output for a particular channel.
 void process_outputs(channel_t* channel, int cur_scan_freq) {
     for (int k = 0; k < channel->output_count; k++) {
         if (channel->outputs[k].enabled == false)
             continue;
+        output_write_timer timer(&channel->outputs[k]);
         if (channel->outputs[k].type == O_ICECAST) {
             icecast_data* icecast = (icecast_data*)(channel->outputs[k].data);
             if (icecast->shout == NULL)
                 continue;
 
             // encode and send mp3 to shoutcast output
-            const auto& lame = channel->outputs[k].lame;
-            const auto& lamebuf = channel->outputs[k].lamebuf;
-            int mp3_bytes = lame_encode_buffer_ieee_float(lame, channel->waveout, (channel->mode == MM_STEREO ? channel->waveout_r : NULL), WAVE_BATCH, lamebuf, LAMEBUF_SIZE);
-            if (mp3_bytes < 0) {
-                log(LOG_WARNING, "lame_encode_buffer_ieee_float: %d\n", mp3_bytes);
-            }
-
-            if (mp3_bytes == 0) {
+            int mp3_bytes = encode_batch(channel, &channel->outputs[k]);
+            if (mp3_bytes <= 0) {
                 continue;
             }
 
@@ -527,15 +770,10 @@ void process_outputs(channel_t* channel, int cur_scan_freq) {
             };
 
             // encode mp3 bytes if O_FILE
-            const auto& lame = channel->outputs[k].lame;
             const auto& lamebuf = channel->outputs[k].lamebuf;
             int mp3_bytes = 0;
             if (channel->outputs[k].type == O_FILE) {
-                mp3_bytes = lame_encode_buffer_ieee_float(lame, channel->waveout, (channel->mode == MM_STEREO ? channel->waveout_r : NULL), WAVE_BATCH, lamebuf, LAMEBUF_SIZE);
-                if (mp3_bytes < 0) {
-                    log(LOG_WARNING, "lame_encode_buffer_ieee_float: %d\n", mp3_bytes);
-                }
-
+                mp3_bytes = encode_batch(channel, &channel->outputs[k]);
                 if (mp3_bytes <= 0) {
                     continue;
                 }
@@ -562,6 +800,26 @@ void process_outputs(channel_t* channel, int cur_scan_freq) {
         } else if (channel->outputs[k].type == O_MIXER) {
             mixer_data* mdata = (mixer_data*)(channel->outputs[k].data);
             mixer_put_samples(mdata->mixer, mdata->input, channel->waveout, channel->axcindicate != NO_SIGNAL, WAVE_BATCH);
+        } else if (channel->outputs[k].type == O_REPLAY) {
+            replay_data* rdata = (replay_data*)(channel->outputs[k].data);
+            const bool has_signal = (channel->axcindicate != NO_SIGNAL);
+            const auto& lame = channel->outputs[k].lame;
+            const auto& lamebuf = channel->outputs[k].lamebuf;
+            int mp3_bytes;
+
+            if (rdata->continuous == false && has_signal == false) {
+                if (rdata->in_transmission == false) {
+                    continue;
+                }
+                // transmission has just ended, push out whatever the encoder is still holding
+                mp3_bytes = lame_encode_flush_nogap(lame, lamebuf, LAMEBUF_SIZE);
+                if (mp3_bytes < 0) {
+                    log(LOG_WARNING, "lame_encode_flush_nogap: %d\n", mp3_bytes);
+                }
+            } else {
+                mp3_bytes = encode_batch(channel, &channel->outputs[k]);
+            }
+            replay_put(rdata, lamebuf, mp3_bytes > 0 ? (size_t)mp3_bytes : 0, has_signal);
         } else if (channel->outputs[k].type == O_UDP_STREAM) {
             udp_stream_data* sdata = (udp_stream_data*)channel->outputs[k].data;
 
@@ -839,6 +1097,103 @@ static void output_output_overruns(FILE* f) {
     fprintf(f, "\n");
 }
 
+static void output_demod_lag(FILE* f) {
+    fprintf(f,
+            "# HELP demod_lag_seconds Most input waiting for the demodulator since the previous stats write.\n"
+            "# TYPE demod_lag_seconds gauge\n");
+
+    for (int i = 0; i < device_count; i++) {
+        device_t* dev = devices + i;
+        double bytes_per_sec = (double)dev->input->sample_rate * dev->input->bytes_per_sample * 2;
+        fprintf(f, "demod_lag_seconds{device=\"%d\"}\t%.3f\n", i, atomic_take(&dev->max_input_backlog) / bytes_per_sec);
+    }
+    fprintf(f, "\n");
+}
+
+static const char* output_type_name(enum output_type type) {
+    switch (type) {
+        case O_ICECAST:
+            return "icecast";
+        case O_FILE:
+            return "file";
+        case O_RAWFILE:
+            return "rawfile";
+        case O_MIXER:
+            return "mixer";
+        case O_UDP_STREAM:
+            return "udp_stream";
+        case O_REPLAY:
+            return "replay";
+#ifdef WITH_PULSEAUDIO
+        case O_PULSE:
+            return "pulse";
+#endif /* WITH_PULSEAUDIO */
+    }
+    return "unknown";
+}
+
+// Call print for every output of every device channel and mixer, with the labels identifying its owner.
+static void print_outputs(FILE* f, void (*print)(FILE* f, char const* owner, output_t* output, int k)) {
+    char owner[64];
+    for (int i = 0; i < device_count; i++) {
+        device_t* dev = devices + i;
+        for (int j = 0; j < dev->channel_count; j++) {
+            channel_t* channel = dev->channels + j;
+            snprintf(owner, sizeof(owner), "device=\"%d\",channel=\"%d\"", i, j);
+            for (int k = 0; k < channel->output_count; k++) {
+                print(f, owner, channel->outputs + k, k);
+            }
+        }
+    }
+    for (int i = 0; i < mixer_count; i++) {
+        channel_t* channel = &mixers[i].channel;
+        snprintf(owner, sizeof(owner), "mixer=\"%d\"", i);
+        for (int k = 0; k < channel->output_count; k++) {
+            print(f, owner, channel->outputs + k, k);
+        }
+    }
+    fprintf(f, "\n");
+}
+
+static void print_output_write_time(FILE* f, char const* owner, output_t* output, int k) {
+    fprintf(f, "output_write_max_seconds{%s,output=\"%d\",type=\"%s\"}\t%.6f\n", owner, k, output_type_name(output->type), atomic_take(&output->max_write_time));
+}
+
+static void output_output_write_times(FILE* f) {
+    fprintf(f,
+            "# HELP output_write_max_seconds Longest time spent handling one batch for an output since the previous stats write.\n"
+            "# TYPE output_write_max_seconds gauge\n");
+    print_outputs(f, print_output_write_time);
+}
+
+static void print_encoder_preset(FILE* f, char const* owner, output_t* output, int k) {
+    if (output->has_mp3_output) {
+        pthread_mutex_lock(&active_preset_lock);
+        encoder_preset preset = output->active_preset;
+        pthread_mutex_unlock(&active_preset_lock);
+        fprintf(f, "encoder_preset{%s,output=\"%d\",type=\"%s\",mode=\"%s\",bitrate=\"%d\",quality=\"%d\"}\t1\n", owner, k, output_type_name(output->type), preset.vbr ? "vbr" : "cbr",
+                preset.bitrate, preset.quality);
+    }
+}
+
+static void print_encoder_cpu_time(FILE* f, char const* owner, output_t* output, int k) {
+    if (output->has_mp3_output) {
+        fprintf(f, "encoder_cpu_seconds_per_batch{%s,output=\"%d\",type=\"%s\"}\t%.6f\n", owner, k, output_type_name(output->type), atomic_read(&output->encode_cpu_per_batch));
+    }
+}
+
+static void output_encoders(FILE* f) {
+    fprintf(f,
+            "# HELP encoder_preset MP3 encoder settings in use, quality is lowered when the encoders go over encoder_cpu_budget.\n"
+            "# TYPE encoder_preset gauge\n");
+    print_outputs(f, print_encoder_preset);
+
+    fprintf(f,
+            "# HELP encoder_cpu_seconds_per_batch Average CPU time spent encoding one batch of audio.\n"
+            "# TYPE encoder_cpu_seconds_per_batch gauge\n");
+    print_outputs(f, print_encoder_cpu_time);
+}
+
 static void output_input_overruns(FILE* f) {
     if (mixer_count == 0) {
         return;
@@ -892,10 +1247,112 @@ void write_stats_file(timeval* last_stats_write) {
     output_device_buffer_overflows(file);
     output_output_overruns(file);
     output_input_overruns(file);
+    output_demod_lag(file);
+    output_output_write_times(file);
+    output_encoders(file);
 
     fclose(file);
 }
 
+// Lower the preset by one step, false if it is already the cheapest one. Only the LAME quality is
+// lowered, which selects how much of the psychoacoustic model and noise shaping run for each frame;
+// VBR / CBR and the bitrate stay as configured.
+static bool encoder_step_down(encoder_preset* preset) {
+    if (preset->quality < 9) {
+        preset->quality++;
+        return true;
+    }
+    return false;
+}
+
+struct encoder_usage {
+    double cpu_time;         // used by the encoders which are not waiting for a lowered preset
+    output_t* costliest;     // the encoder which used the most and can still step down, files last
+    double costliest_time;
+    std::string costliest_name;
+};
+
+struct encoder_budget_state {
+    timeval last_check;
+    int over_count;  // consecutive checks over budget
+};
+
+static void account_encoders(channel_t* channel, const std::string& owner, encoder_usage* usage) {
+    for (int k = 0; k < channel->output_count; k++) {
+        output_t* output = channel->outputs + k;
+        if (!output->has_mp3_output || output->lame == NULL) {
+            continue;
+        }
+        atomic_write(&output->encode_cpu_per_batch, output->encoded_batches > 0 ? output->encode_cpu_time / output->encoded_batches : 0.0);
+
+        // an output already lowered but still on its old encoder (files: until the next file) is left
+        // out, rather than getting the others lowered meanwhile for CPU time it is going to save
+        if (!output->preset_changed) {
+            usage->cpu_time += output->encode_cpu_time;
+
+            // files only switch with the next file, so lower anything else first
+            bool later = (output->type == O_FILE);
+            bool costliest_later = (usage->costliest != NULL && usage->costliest->type == O_FILE);
+            bool costlier = usage->costliest == NULL || (later == costliest_later ? output->encode_cpu_time > usage->costliest_time : costliest_later);
+            encoder_preset lower = output->preset;
+            if (output->enabled && encoder_step_down(&lower) && costlier) {
+                usage->costliest = output;
+                usage->costliest_time = output->encode_cpu_time;
+                usage->costliest_name = owner + " output " + std::to_string(k);
+            }
+        }
+        output->encode_cpu_time = 0.0;
+        output->encoded_batches = 0;
+    }
+}
+
+// Compare the CPU time used by the encoders of this output thread with encoder_cpu_budget every
+// ENCODER_BUDGET_INTERVAL seconds. When over budget for ENCODER_BUDGET_CHECKS checks in a row, lower
+// the preset of the costliest encoder by one step; the output switches to it before its next batch
+// (files: with the next file). Outputs waiting for that switch do not count towards the budget until
+// it has happened. Presets are never raised again, the configured ones come back with a restart.
+static void check_encoder_budget(output_params_t* params, encoder_budget_state* state) {
+    static const double ENCODER_BUDGET_INTERVAL = 10.0;
+    static const int ENCODER_BUDGET_CHECKS = 3;
+
+    timeval now;
+    gettimeofday(&now, NULL);
+    if (state->last_check.tv_sec == 0) {
+        state->last_check = now;
+        return;
+    }
+    double elapsed = delta_sec(&state->last_check, &now);
+    if (elapsed < ENCODER_BUDGET_INTERVAL) {
+        return;
+    }
+    state->last_check = now;
+
+    encoder_usage usage = {0.0, NULL, 0.0, ""};
+    for (int i = params->mixer_start; i < params->mixer_end; i++) {
+        account_encoders(&mixers[i].channel, "mixer " + std::to_string(i), &usage);
+    }
+    for (int i = params->device_start; i < params->device_end; i++) {
+        for (int j = 0; j < devices[i].channel_count; j++) {
+            account_encoders(devices[i].channels + j, "device " + std::to_string(i) + " channel " + std::to_string(j), &usage);
+        }
+    }
+
+    double used = usage.cpu_time / elapsed * 100.0;
+    if (encoder_cpu_budget == 0 || used <= encoder_cpu_budget) {
+        state->over_count = 0;
+        return;
+    }
+    if (++state->over_count < ENCODER_BUDGET_CHECKS || usage.costliest == NULL) {
+        return;
+    }
+    state->over_count = 0;
+
+    encoder_step_down(&usage.costliest->preset);
+    usage.costliest->preset_changed = true;
+    log(LOG_WARNING, "Encoders used %.0f%% CPU, over the budget of %d%%, lowering the quality of %s to %d\n", used, encoder_cpu_budget, usage.costliest_name.c_str(),
+        usage.costliest->preset.quality);
+}
+
 void* output_thread(void* param) {
     assert(param != NULL);
     output_params_t* output_param = (output_params_t*)param;
@@ -903,6 +1360,7 @@ void* output_thread(void* param) {
     struct timeval tv;
     int new_freq = -1;
     timeval last_stats_write = {0, 0};
+    encoder_budget_state budget_state = {{0, 0}, 0};
 
     debug_print("Starting output thread, devices %d:%d, mixers %d:%d, signal %p\n", output_param->device_start, output_param->device_end, output_param->mixer_start, output_param->mixer_end,
                 output_param->mp3_signal);
@@ -953,6 +1411,7 @@ void* output_thread(void* param) {
             // in multichannel mode
             new_freq = -1;
         }
+        check_encoder_budget(output_param, &budget_state);
         if (output_param->device_start == 0) {
             write_stats_file(&last_stats_write);
         }
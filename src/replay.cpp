@@ -0,0 +1,384 @@
+/*
+ * replay.cpp
+ * Instant replay of recently encoded audio
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+#include <fcntl.h>       // fcntl()
+#include <poll.h>        // poll()
+#include <string.h>      // strerror()
+#include <sys/socket.h>  // socket(), bind(), accept()
+#include <sys/stat.h>    // lstat()
+#include <sys/time.h>    // gettimeofday()
+#include <sys/un.h>      // sockaddr_un
+#include <syslog.h>      // LOG_INFO / LOG_ERR
+#include <unistd.h>      // close(), unlink()
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "boondock_airband.h"
+#include "helper_functions.h"
+
+using namespace std;
+
+char* replay_socket_path = NULL;
+volatile int replay_dump_requested = 0;
+
+static const int REPLAY_CLIENT_TIMEOUT_SEC = 5;  // without any progress
+static const size_t REPLAY_MAX_CLIENTS = 16;
+static const size_t REPLAY_MAX_REQUEST = 255;
+
+static_assert(WAVE_RATE / WAVE_BATCH == 8, "replay buffers store one chunk per batch");
+
+// max_bitrate (kbps) is the most the replay encoder produces, see init_output()
+bool replay_init(replay_data* rdata, int max_bitrate) {
+    size_t max_chunks = ReplayBuffer::chunks_for(rdata->duration, WAVE_RATE / WAVE_BATCH);
+    size_t max_bytes = (size_t)rdata->duration * max_bitrate * 1000 / 8;
+    rdata->buffer = new ReplayBuffer(rdata->duration, max_chunks, max_bytes);
+    rdata->in_transmission = rdata->transmission_starting = false;
+    log(LOG_INFO, "Replay buffer %s: %d sec, up to %zu kB\n", rdata->name, rdata->duration, max_bytes / 1024);
+    return true;
+}
+
+void replay_put(replay_data* rdata, const unsigned char* data, size_t len, bool has_signal) {
+    if (has_signal && !rdata->in_transmission) {
+        rdata->transmission_starting = true;
+    }
+    rdata->in_transmission = has_signal;
+    if (len == 0) {
+        return;
+    }
+
+    timeval now;
+    gettimeofday(&now, NULL);
+    rdata->buffer->put(data, len, now, rdata->transmission_starting);
+    rdata->transmission_starting = false;
+}
+
+// Walk all replay outputs of all devices and mixers, stopping when the callback returns true
+template <class CALLBACK>
+static void for_each_replay(CALLBACK callback) {
+    for (int i = 0; i < device_count; i++) {
+        for (int j = 0; j < devices[i].channel_count; j++) {
+            channel_t* channel = devices[i].channels + j;
+            for (int k = 0; k < channel->output_count; k++) {
+                if (channel->outputs[k].type == O_REPLAY && callback((replay_data*)channel->outputs[k].data)) {
+                    return;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < mixer_count; i++) {
+        channel_t* channel = &mixers[i].channel;
+        for (int k = 0; k < channel->output_count; k++) {
+            if (channel->outputs[k].type == O_REPLAY && callback((replay_data*)channel->outputs[k].data)) {
+                return;
+            }
+        }
+    }
+}
+
+static replay_data* find_replay(const char* name) {
+    replay_data* found = NULL;
+    for_each_replay([&](replay_data* rdata) {
+        if (rdata->buffer != NULL && strcmp(rdata->name, name) == 0) {
+            found = rdata;
+        }
+        return found != NULL;
+    });
+    return found;
+}
+
+bool replay_enabled() {
+    bool found = false;
+    for_each_replay([&](replay_data*) {
+        found = true;
+        return true;
+    });
+    return found;
+}
+
+static void replay_dump(replay_data* rdata, const timeval& now) {
+    vector<unsigned char> clip;
+    if (rdata->buffer == NULL || rdata->directory == NULL || rdata->buffer->get_seconds(now, 0, clip) == 0) {
+        return;
+    }
+
+    struct tm* time = use_localtime ? localtime(&now.tv_sec) : gmtime(&now.tv_sec);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "_%Y%m%d_%H%M%S", time);
+
+    make_dir(rdata->directory);
+    string path = string(rdata->directory) + '/' + rdata->name + "_replay" + timestamp + ".mp3";
+    FILE* f = fopen(path.c_str(), "w");
+    if (f == NULL) {
+        log(LOG_WARNING, "Cannot open replay file %s (%s)\n", path.c_str(), strerror(errno));
+        return;
+    }
+    if (fwrite(clip.data(), 1, clip.size(), f) != clip.size()) {
+        log(LOG_WARNING, "Cannot write replay file %s (%s)\n", path.c_str(), strerror(errno));
+    } else {
+        log(LOG_INFO, "Saved %zu bytes of replay to %s\n", clip.size(), path.c_str());
+    }
+    fclose(f);
+}
+
+static void replay_dump_all() {
+    timeval now;
+    gettimeofday(&now, NULL);
+    for_each_replay([&](replay_data* rdata) {
+        replay_dump(rdata, now);
+        return false;
+    });
+}
+
+static void append_reply(vector<unsigned char>& reply, const char* format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len > 0) {
+        reply.insert(reply.end(), buf, buf + std::min((size_t)len, sizeof(buf) - 1));
+    }
+}
+
+/*
+ * Answer a single request from a replay socket client. Requests are single lines:
+ *   list                - one line per replay buffer: name, transmission count, bytes buffered
+ *   get <name> [sec]    - encoded audio from the last sec seconds (default: whole buffer)
+ *   last <name> [count] - encoded audio starting from the count-th most recent transmission (default: 1)
+ * Audio is sent as is and the connection is closed afterwards.
+ */
+static void replay_request(const char* line, vector<unsigned char>& reply) {
+    char cmd[16], name[128];
+    int arg = 0;
+    int fields = sscanf(line, "%15s %127s %d", cmd, name, &arg);
+    if (fields < 1) {
+        append_reply(reply, "ERR empty request\n");
+        return;
+    }
+
+    timeval now;
+    gettimeofday(&now, NULL);
+
+    if (strcmp(cmd, "list") == 0) {
+        for_each_replay([&](replay_data* rdata) {
+            if (rdata->buffer != NULL) {
+                append_reply(reply, "%s\t%zu\t%zu\n", rdata->name, rdata->buffer->transmission_count(now), rdata->buffer->bytes());
+            }
+            return false;
+        });
+        return;
+    }
+
+    if (strcmp(cmd, "get") != 0 && strcmp(cmd, "last") != 0) {
+        append_reply(reply, "ERR unknown command %s\n", cmd);
+        return;
+    }
+    if (fields < 2) {
+        append_reply(reply, "ERR missing name\n");
+        return;
+    }
+    replay_data* rdata = find_replay(name);
+    if (rdata == NULL) {
+        append_reply(reply, "ERR unknown replay buffer %s\n", name);
+        return;
+    }
+
+    if (strcmp(cmd, "get") == 0) {
+        rdata->buffer->get_seconds(now, fields > 2 ? arg : 0, reply);
+    } else {
+        rdata->buffer->get_transmissions(now, fields > 2 ? arg : 1, reply);
+    }
+    debug_print("replay %s %s %d: sending %zu bytes\n", cmd, name, arg, reply.size());
+}
+
+/*
+ * Replay socket clients are served together with non-blocking reads and writes, so a client which
+ * is slow to send its request or to read its clip holds up nobody else. A client is dropped after
+ * REPLAY_CLIENT_TIMEOUT_SEC without any progress.
+ */
+struct replay_client {
+    int fd;
+    string request;
+    vector<unsigned char> reply;
+    size_t sent;
+    bool answered;
+    time_t last_progress;
+};
+
+// read what the client has sent, false when the client is done with
+static bool replay_client_read(replay_client& client) {
+    char buf[256];
+    ssize_t ret = recv(client.fd, buf, sizeof(buf), 0);
+    if (ret < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    client.request.append(buf, (size_t)ret);
+    size_t eol = client.request.find('\n');
+    if (ret == 0 || eol != string::npos || client.request.size() >= REPLAY_MAX_REQUEST) {
+        client.request.resize(std::min(client.request.size(), std::min(eol, (size_t)REPLAY_MAX_REQUEST)));
+        replay_request(client.request.c_str(), client.reply);
+        client.answered = true;
+    }
+    return true;
+}
+
+// send as much of the reply as the socket takes, false when the client is done with
+static bool replay_client_write(replay_client& client) {
+    while (client.sent < client.reply.size()) {
+        ssize_t ret = send(client.fd, client.reply.data() + client.sent, client.reply.size() - client.sent, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        client.sent += (size_t)ret;
+    }
+    return false;
+}
+
+static void replay_accept(int listen_fd, vector<replay_client>& clients) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    if (clients.size() >= REPLAY_MAX_CLIENTS) {
+        log(LOG_WARNING, "Too many replay socket clients, rejecting a connection\n");
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    replay_client client = {fd, "", vector<unsigned char>(), 0, false, time(NULL)};
+    clients.push_back(client);
+}
+
+static void replay_serve(int listen_fd, vector<replay_client>& clients) {
+    vector<struct pollfd> pfds;
+    pfds.push_back({listen_fd, POLLIN, 0});
+    for (auto& client : clients) {
+        pfds.push_back({client.fd, (short)(client.answered ? POLLOUT : POLLIN), 0});
+    }
+    if (poll(pfds.data(), pfds.size(), 500) < 0) {
+        return;
+    }
+
+    time_t now = time(NULL);
+    for (size_t i = 0; i < clients.size();) {
+        replay_client& client = clients[i];
+        short revents = pfds[i + 1].revents;
+        bool keep = true;
+        if (revents & (POLLERR | POLLHUP | POLLNVAL) && !(revents & (POLLIN | POLLOUT))) {
+            keep = false;
+        } else if (revents & (POLLIN | POLLOUT)) {
+            size_t progress = client.request.size() + client.sent;
+            keep = client.answered ? replay_client_write(client) : replay_client_read(client);
+            if (client.answered && keep && client.sent == 0) {
+                keep = replay_client_write(client);  // try right away, the reply may fit in the socket buffer
+            }
+            if (client.request.size() + client.sent != progress) {
+                client.last_progress = now;
+            }
+        } else if (now - client.last_progress > REPLAY_CLIENT_TIMEOUT_SEC) {
+            debug_print("replay client timed out, %zu of %zu bytes sent\n", client.sent, client.reply.size());
+            keep = false;
+        }
+        if (keep) {
+            i++;
+        } else {
+            close(client.fd);
+            clients.erase(clients.begin() + i);
+            pfds.erase(pfds.begin() + i + 1);
+        }
+    }
+
+    if (pfds[0].revents & POLLIN) {
+        replay_accept(listen_fd, clients);
+    }
+}
+
+static int replay_socket_open(const char* path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log(LOG_ERR, "Replay socket path %s is too long\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    // remove a socket left behind by a previous run, but nothing else
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            log(LOG_ERR, "Replay socket path %s exists and is not a socket\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        log(LOG_ERR, "Cannot create replay socket: %s\n", strerror(errno));
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        log(LOG_ERR, "Cannot listen on replay socket %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    log(LOG_INFO, "Replay socket listening on %s\n", path);
+    return fd;
+}
+
+// serve replay socket clients and save replay buffers to files when requested with SIGUSR1
+void* replay_thread(void*) {
+    int listen_fd = replay_socket_path ? replay_socket_open(replay_socket_path) : -1;
+
+    vector<replay_client> clients;
+
+    while (!do_exit) {
+        if (listen_fd >= 0) {
+            replay_serve(listen_fd, clients);
+        } else {
+            SLEEP(500);
+        }
+
+        if (replay_dump_requested) {
+            replay_dump_requested = 0;
+            replay_dump_all();
+        }
+    }
+
+    for (auto& client : clients) {
+        close(client.fd);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(replay_socket_path);
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * replay_buffer.cpp
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>  // assert()
+#include <cstdlib>  // calloc(), free()
+#include <cstring>  // memcpy()
+
+#include "replay_buffer.h"
+
+using namespace std;
+
+static double age_sec(const struct timeval& then, const struct timeval& now) {
+    return (double)(now.tv_sec - then.tv_sec) + (double)(now.tv_usec - then.tv_usec) / 1000000.0;
+}
+
+ReplayBuffer::ReplayBuffer(int duration_sec, size_t max_chunks, size_t max_bytes)
+    : duration_sec_(duration_sec), max_chunks_(max_chunks), chunk_tail_(0), chunk_count_(0), max_bytes_(max_bytes), write_pos_(0), used_bytes_(0) {
+    assert(max_chunks_ > 0);
+    assert(max_bytes_ > 0);
+    chunks_ = (Chunk*)calloc(max_chunks_, sizeof(Chunk));
+    data_ = (unsigned char*)calloc(max_bytes_, 1);
+    assert(chunks_ != NULL && data_ != NULL);
+    pthread_mutex_init(&mutex_, NULL);
+}
+
+ReplayBuffer::~ReplayBuffer(void) {
+    pthread_mutex_destroy(&mutex_);
+    free(chunks_);
+    free(data_);
+}
+
+void ReplayBuffer::drop_oldest(void) {
+    used_bytes_ -= chunks_[chunk_tail_].len;
+    chunk_tail_ = (chunk_tail_ + 1) % max_chunks_;
+    chunk_count_--;
+}
+
+void ReplayBuffer::put(const unsigned char* data, size_t len, const struct timeval& tv, bool transmission_start) {
+    if (len == 0 || len > max_bytes_) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex_);
+    while (chunk_count_ > 0 && (chunk_count_ == max_chunks_ || used_bytes_ + len > max_bytes_ || age_sec(chunk(0).tv, tv) > duration_sec_)) {
+        drop_oldest();
+    }
+
+    Chunk& c = chunk(chunk_count_);
+    c.offset = write_pos_;
+    c.len = len;
+    c.tv = tv;
+    c.transmission_start = transmission_start;
+    chunk_count_++;
+
+    size_t first_part = max_bytes_ - write_pos_;
+    if (first_part >= len) {
+        memcpy(data_ + write_pos_, data, len);
+    } else {
+        memcpy(data_ + write_pos_, data, first_part);
+        memcpy(data_, data + first_part, len - first_part);
+    }
+    write_pos_ = (write_pos_ + len) % max_bytes_;
+    used_bytes_ += len;
+    pthread_mutex_unlock(&mutex_);
+}
+
+// index of the oldest chunk not older than `seconds` (capped to the buffer duration), chunk_count_ if none
+size_t ReplayBuffer::first_valid(const struct timeval& now, int seconds) {
+    if (seconds <= 0 || seconds > duration_sec_) {
+        seconds = duration_sec_;
+    }
+    size_t idx = 0;
+    while (idx < chunk_count_ && age_sec(chunk(idx).tv, now) > seconds) {
+        idx++;
+    }
+    return idx;
+}
+
+void ReplayBuffer::copy_out(size_t first, vector<unsigned char>& out) {
+    for (size_t idx = first; idx < chunk_count_; idx++) {
+        const Chunk& c = chunk(idx);
+        size_t first_part = max_bytes_ - c.offset;
+        if (first_part >= c.len) {
+            out.insert(out.end(), data_ + c.offset, data_ + c.offset + c.len);
+        } else {
+            out.insert(out.end(), data_ + c.offset, data_ + max_bytes_);
+            out.insert(out.end(), data_, data_ + c.len - first_part);
+        }
+    }
+}
+
+size_t ReplayBuffer::get_seconds(const struct timeval& now, int seconds, vector<unsigned char>& out) {
+    size_t before = out.size();
+    pthread_mutex_lock(&mutex_);
+    copy_out(first_valid(now, seconds), out);
+    pthread_mutex_unlock(&mutex_);
+    return out.size() - before;
+}
+
+size_t ReplayBuffer::get_transmissions(const struct timeval& now, int count, vector<unsigned char>& out) {
+    size_t before = out.size();
+    pthread_mutex_lock(&mutex_);
+    size_t first = first_valid(now, duration_sec_);
+    size_t idx = chunk_count_;
+    int found = 0;
+    while (idx > first && found < count) {
+        idx--;
+        if (chunk(idx).transmission_start) {
+            found++;
+        }
+    }
+    copy_out(found == count ? idx : first, out);
+    pthread_mutex_unlock(&mutex_);
+    return out.size() - before;
+}
+
+size_t ReplayBuffer::transmission_count(const struct timeval& now) {
+    size_t count = 0;
+    pthread_mutex_lock(&mutex_);
+    for (size_t idx = first_valid(now, duration_sec_); idx < chunk_count_; idx++) {
+        if (chunk(idx).transmission_start) {
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&mutex_);
+    return count;
+}
+
+size_t ReplayBuffer::bytes(void) {
+    pthread_mutex_lock(&mutex_);
+    size_t ret = used_bytes_;
+    pthread_mutex_unlock(&mutex_);
+    return ret;
+}
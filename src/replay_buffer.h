@@ -0,0 +1,88 @@
+/*
+ * replay_buffer.h
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _REPLAY_BUFFER_H
+#define _REPLAY_BUFFER_H
+
+#include <pthread.h>
+#include <sys/time.h>  // struct timeval
+#include <cstddef>     // size_t
+#include <vector>
+
+/*
+ Ring of already-encoded audio for instant replay.
+
+ Encoded data is stored as a sequence of chunks (typically whatever one call to the encoder returned)
+ in a fixed-size byte ring. Each chunk carries the time it was stored and a flag marking the start of a
+ transmission (squelch opening). The oldest chunks are dropped when the byte ring or the chunk index
+ is full, or when they are older than the configured duration.
+
+ Readers copy the data out under a lock, so retrieval never blocks on anything but the copy itself.
+ */
+
+class ReplayBuffer {
+   public:
+    ReplayBuffer(int duration_sec, size_t max_chunks, size_t max_bytes);
+    ~ReplayBuffer(void);
+
+    // chunk index size needed to hold duration_sec of chunks stored chunks_per_sec times a second
+    static size_t chunks_for(int duration_sec, int chunks_per_sec) { return (size_t)duration_sec * chunks_per_sec + 1; }
+
+    void put(const unsigned char* data, size_t len, const struct timeval& tv, bool transmission_start);
+
+    size_t get_seconds(const struct timeval& now, int seconds, std::vector<unsigned char>& out);
+    size_t get_transmissions(const struct timeval& now, int count, std::vector<unsigned char>& out);
+
+    size_t transmission_count(const struct timeval& now);
+    size_t bytes(void);
+    int duration(void) const { return duration_sec_; }
+    size_t max_chunks(void) const { return max_chunks_; }
+
+   private:
+    struct Chunk {
+        size_t offset;
+        size_t len;
+        struct timeval tv;
+        bool transmission_start;
+    };
+
+    ReplayBuffer(const ReplayBuffer&);
+    ReplayBuffer& operator=(const ReplayBuffer&);
+
+    Chunk& chunk(size_t idx) { return chunks_[(chunk_tail_ + idx) % max_chunks_]; }
+    void drop_oldest(void);
+    size_t first_valid(const struct timeval& now, int seconds);
+    void copy_out(size_t first, std::vector<unsigned char>& out);
+
+    int duration_sec_;
+
+    size_t max_chunks_;
+    size_t chunk_tail_;   // index of the oldest chunk
+    size_t chunk_count_;  // number of chunks stored
+    Chunk* chunks_;
+
+    size_t max_bytes_;
+    size_t write_pos_;   // offset of the next byte to be written
+    size_t used_bytes_;  // bytes held by stored chunks
+    unsigned char* data_;
+
+    pthread_mutex_t mutex_;
+};
+
+#endif /* _REPLAY_BUFFER_H */
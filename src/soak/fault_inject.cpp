@@ -0,0 +1,252 @@
+/*
+ * fault_inject.cpp
+ * LD_PRELOAD shim making writes to some files slow and sends to some UDP ports fail
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ Controlled with environment variables:
+
+ FAULT_SLOW_DIR         files opened below this directory are "on a slow disk"
+ FAULT_WRITE_DELAY_MS   latency of a write to a slow file (default: 2000)
+ FAULT_UDP_ERROR_PORT   sends to this UDP port fail with ECONNREFUSED
+
+ stdio buffers writes and flushes through internal calls which can't be interposed, so for FILE streams
+ the delay is applied to fwrite() whenever the data written since the last delay would have filled a
+ BUFSIZ buffer, and to fflush() / fclose() of pending data. Plain write() / pwrite() on a slow file
+ descriptor is always delayed.
+ */
+
+// the 64-bit variants are interposed explicitly
+#undef _FILE_OFFSET_BITS
+#undef _FORTIFY_SOURCE
+
+#include <dlfcn.h>       // dlsym()
+#include <errno.h>
+#include <fcntl.h>       // open()
+#include <netinet/in.h>  // sockaddr_in
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>  // getenv()
+#include <string.h>
+#include <sys/socket.h>  // sendto(), getpeername()
+#include <unistd.h>      // write(), usleep()
+#include <atomic>
+
+static const int MAX_FD = 4096;
+
+static std::atomic<bool> slow_fd[MAX_FD];
+static std::atomic<size_t> pending_bytes[MAX_FD];  // written to a slow FILE since its last delay
+
+static const char* slow_dir;
+static size_t slow_dir_len;
+static useconds_t write_delay_usec = 2000000;
+static int udp_error_port = -1;
+
+// look up the next definition of a function, once
+#define REAL(name, type)                                           \
+    static type real_##name = NULL;                                \
+    if (real_##name == NULL) {                                     \
+        real_##name = (type)dlsym(RTLD_NEXT, #name);               \
+    }
+
+__attribute__((constructor)) static void fault_inject_init(void) {
+    slow_dir = getenv("FAULT_SLOW_DIR");
+    slow_dir_len = slow_dir ? strlen(slow_dir) : 0;
+    const char* env = getenv("FAULT_WRITE_DELAY_MS");
+    if (env != NULL) {
+        write_delay_usec = (useconds_t)atoi(env) * 1000;
+    }
+    env = getenv("FAULT_UDP_ERROR_PORT");
+    if (env != NULL) {
+        udp_error_port = atoi(env);
+    }
+}
+
+static bool is_slow_path(const char* path) {
+    return slow_dir_len > 0 && path != NULL && strncmp(path, slow_dir, slow_dir_len) == 0;
+}
+
+static bool is_slow(int fd) {
+    return fd >= 0 && fd < MAX_FD && slow_fd[fd];
+}
+
+static void mark(int fd, bool slow) {
+    if (fd >= 0 && fd < MAX_FD) {
+        slow_fd[fd] = slow;
+        pending_bytes[fd] = 0;
+    }
+}
+
+static void stall(void) {
+    usleep(write_delay_usec);
+}
+
+static bool is_error_port(int fd, const struct sockaddr* addr) {
+    if (udp_error_port < 0) {
+        return false;
+    }
+    struct sockaddr_storage peer;
+    if (addr == NULL) {
+        socklen_t len = sizeof(peer);
+        if (getpeername(fd, (struct sockaddr*)&peer, &len) != 0) {
+            return false;
+        }
+        addr = (struct sockaddr*)&peer;
+    }
+    if (addr->sa_family == AF_INET) {
+        return ntohs(((const struct sockaddr_in*)addr)->sin_port) == udp_error_port;
+    }
+    if (addr->sa_family == AF_INET6) {
+        return ntohs(((const struct sockaddr_in6*)addr)->sin6_port) == udp_error_port;
+    }
+    return false;
+}
+
+typedef FILE* (*fopen_func_t)(const char*, const char*);
+typedef int (*open_func_t)(const char*, int, ...);
+typedef size_t (*fwrite_func_t)(const void*, size_t, size_t, FILE*);
+typedef int (*fflush_func_t)(FILE*);
+typedef ssize_t (*write_func_t)(int, const void*, size_t);
+typedef ssize_t (*pwrite_func_t)(int, const void*, size_t, off_t);
+typedef ssize_t (*pwrite64_func_t)(int, const void*, size_t, off64_t);
+typedef int (*close_func_t)(int);
+typedef ssize_t (*send_func_t)(int, const void*, size_t, int);
+typedef ssize_t (*sendto_func_t)(int, const void*, size_t, int, const struct sockaddr*, socklen_t);
+
+extern "C" {
+
+FILE* fopen(const char* path, const char* mode) {
+    REAL(fopen, fopen_func_t);
+    FILE* f = real_fopen(path, mode);
+    if (f != NULL) {
+        mark(fileno(f), is_slow_path(path));
+    }
+    return f;
+}
+
+FILE* fopen64(const char* path, const char* mode) {
+    REAL(fopen64, fopen_func_t);
+    FILE* f = real_fopen64(path, mode);
+    if (f != NULL) {
+        mark(fileno(f), is_slow_path(path));
+    }
+    return f;
+}
+
+int open(const char* path, int flags, ...) {
+    REAL(open, open_func_t);
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = (flags & (O_CREAT | O_TMPFILE)) ? va_arg(args, mode_t) : 0;
+    va_end(args);
+    int fd = real_open(path, flags, mode);
+    mark(fd, is_slow_path(path));
+    return fd;
+}
+
+int open64(const char* path, int flags, ...) {
+    REAL(open64, open_func_t);
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = (flags & (O_CREAT | O_TMPFILE)) ? va_arg(args, mode_t) : 0;
+    va_end(args);
+    int fd = real_open64(path, flags, mode);
+    mark(fd, is_slow_path(path));
+    return fd;
+}
+
+size_t fwrite(const void* ptr, size_t size, size_t nmemb, FILE* stream) {
+    REAL(fwrite, fwrite_func_t);
+    int fd = fileno(stream);
+    if (is_slow(fd) && (pending_bytes[fd] += size * nmemb) >= BUFSIZ) {
+        pending_bytes[fd] = 0;
+        stall();
+    }
+    return real_fwrite(ptr, size, nmemb, stream);
+}
+
+int fflush(FILE* stream) {
+    REAL(fflush, fflush_func_t);
+    if (stream != NULL) {
+        int fd = fileno(stream);
+        if (is_slow(fd) && pending_bytes[fd].exchange(0) > 0) {
+            stall();
+        }
+    }
+    return real_fflush(stream);
+}
+
+int fclose(FILE* stream) {
+    REAL(fclose, fflush_func_t);
+    int fd = fileno(stream);
+    if (is_slow(fd) && pending_bytes[fd] > 0) {
+        stall();
+    }
+    mark(fd, false);
+    return real_fclose(stream);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+    REAL(write, write_func_t);
+    if (is_slow(fd)) {
+        stall();
+    }
+    return real_write(fd, buf, count);
+}
+
+ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset) {
+    REAL(pwrite, pwrite_func_t);
+    if (is_slow(fd)) {
+        stall();
+    }
+    return real_pwrite(fd, buf, count, offset);
+}
+
+ssize_t pwrite64(int fd, const void* buf, size_t count, off64_t offset) {
+    REAL(pwrite64, pwrite64_func_t);
+    if (is_slow(fd)) {
+        stall();
+    }
+    return real_pwrite64(fd, buf, count, offset);
+}
+
+int close(int fd) {
+    REAL(close, close_func_t);
+    mark(fd, false);
+    return real_close(fd);
+}
+
+ssize_t send(int fd, const void* buf, size_t len, int flags) {
+    REAL(send, send_func_t);
+    if (is_error_port(fd, NULL)) {
+        errno = ECONNREFUSED;
+        return -1;
+    }
+    return real_send(fd, buf, len, flags);
+}
+
+ssize_t sendto(int fd, const void* buf, size_t len, int flags, const struct sockaddr* addr, socklen_t addrlen) {
+    REAL(sendto, sendto_func_t);
+    if (is_error_port(fd, addr)) {
+        errno = ECONNREFUSED;
+        return -1;
+    }
+    return real_sendto(fd, buf, len, flags, addr, addrlen);
+}
+
+}  // extern "C"
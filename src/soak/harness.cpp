@@ -0,0 +1,251 @@
+/*
+ * harness.cpp
+ * Helpers shared by the soak and fault injection tests
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>     // open()
+#include <ftw.h>       // nftw()
+#include <signal.h>    // kill()
+#include <sys/time.h>  // gettimeofday()
+#include <sys/wait.h>  // waitpid()
+#include <unistd.h>    // fork(), execl(), usleep()
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "harness.h"
+
+using namespace std;
+
+static const int CHANNEL_SPAN = 36000;  // channels are spread evenly over this bandwidth around the center
+static const int LOOP_SEC = 60;         // length of the generated IQ files
+static const int KEY_PERIOD_SEC = 20;   // every channel transmits once per period...
+static const int KEY_ON_SEC = 5;        // ...for this long
+
+double now_sec() {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+string format_time(time_t t) {
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+    return buf;
+}
+
+int channel_offset(int channel, int channel_count) {
+    int spacing = CHANNEL_SPAN / channel_count;
+    // round to 100 Hz so that every carrier completes an integer number of cycles in LOOP_SEC
+    return (-CHANNEL_SPAN / 2 + spacing * channel + spacing / 2) / 100 * 100;
+}
+
+static bool channel_keyed(int device, int channel, int channel_count, int sec) {
+    int phase = ((device * channel_count + channel) * 3) % (KEY_PERIOD_SEC - KEY_ON_SEC);
+    int t = (sec - phase + KEY_PERIOD_SEC) % KEY_PERIOD_SEC;
+    return t < KEY_ON_SEC;
+}
+
+// U8 IQ with AM carriers (1 kHz tone, 50% modulation) switching on and off over a bit of noise
+bool generate_iq(const string& path, int device, int channel_count) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot create %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    vector<unsigned char> buf(2 * HARNESS_SAMPLE_RATE);
+    unsigned int noise_state = 12345 + device;
+    for (int sec = 0; sec < LOOP_SEC; sec++) {
+        for (int s = 0; s < HARNESS_SAMPLE_RATE; s++) {
+            double t = sec + (double)s / HARNESS_SAMPLE_RATE;
+            double i = 0.0, q = 0.0;
+            for (int ch = 0; ch < channel_count; ch++) {
+                if (!channel_keyed(device, ch, channel_count, sec)) {
+                    continue;
+                }
+                double amplitude = 30.0 * (1.0 + 0.5 * sin(2.0 * M_PI * 1000.0 * t));
+                double phi = 2.0 * M_PI * channel_offset(ch, channel_count) * t;
+                i += amplitude * cos(phi);
+                q += amplitude * sin(phi);
+            }
+            noise_state = noise_state * 1103515245 + 12345;
+            i += (double)((noise_state >> 16) % 7) - 3.0;
+            noise_state = noise_state * 1103515245 + 12345;
+            q += (double)((noise_state >> 16) % 7) - 3.0;
+            buf[2 * s] = (unsigned char)fmax(0.0, fmin(255.0, 127.5 + i));
+            buf[2 * s + 1] = (unsigned char)fmax(0.0, fmin(255.0, 127.5 + q));
+        }
+        if (fwrite(buf.data(), 1, buf.size(), f) != buf.size()) {
+            fprintf(stderr, "Cannot write %s: %s\n", path.c_str(), strerror(errno));
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+string file_output_config(const string& dir, const string& name) {
+    return "{ type = \"file\"; directory = \"" + dir + "\"; filename_template = \"" + name + "\"; continuous = true; append = false; }";
+}
+
+string device_config(const string& iq_path, const vector<vector<string> >& channel_outputs) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "  {\n    type = \"file\";\n    filepath = \"%s\";\n    loop = true;\n    speedup_factor = 1;\n    sample_rate = %d;\n    centerfreq = %d;\n", iq_path.c_str(),
+             HARNESS_SAMPLE_RATE, HARNESS_CENTERFREQ);
+    string cfg = buf;
+    cfg += "    channels: (\n";
+    for (size_t c = 0; c < channel_outputs.size(); c++) {
+        snprintf(buf, sizeof(buf), "      {\n        freq = %d;\n        outputs: (\n", HARNESS_CENTERFREQ + channel_offset((int)c, (int)channel_outputs.size()));
+        cfg += buf;
+        for (size_t o = 0; o < channel_outputs[c].size(); o++) {
+            cfg += "          " + channel_outputs[c][o];
+            cfg += (o < channel_outputs[c].size() - 1) ? ",\n" : "\n";
+        }
+        cfg += "        );\n      }";
+        cfg += (c < channel_outputs.size() - 1) ? ",\n" : "\n";
+    }
+    cfg += "    );\n  }";
+    return cfg;
+}
+
+pid_t start_airband(const char* binary, const string& config_path, const string& log_path, const vector<pair<string, string> >& env) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    for (auto& e : env) {
+        setenv(e.first.c_str(), e.second.c_str(), 1);
+    }
+
+    // the status JSON printed to stdout is of no interest here, keep the log for post mortem
+    int devnull = open("/dev/null", O_WRONLY);
+    int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+    }
+    if (log_fd >= 0) {
+        dup2(log_fd, STDERR_FILENO);
+    }
+
+    execl(binary, binary, "-F", "-e", "-c", config_path.c_str(), (char*)NULL);
+    fprintf(stderr, "Cannot execute %s: %s\n", binary, strerror(errno));
+    _exit(127);
+}
+
+bool stop_airband(pid_t pid) {
+    kill(pid, SIGTERM);
+    for (int i = 0; i < 200; i++) {
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        usleep(50000);
+    }
+    fprintf(stderr, "boondock_airband did not exit on SIGTERM, killing it\n");
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return false;
+}
+
+bool airband_exited(pid_t pid, int* status) {
+    return waitpid(pid, status, WNOHANG) == pid;
+}
+
+long read_rss_kb(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[256];
+    long rss = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmRSS: %ld", &rss) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return rss;
+}
+
+bool read_stats(const string& path, stats_t& stats) {
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == NULL) {
+        return false;
+    }
+    stats.clear();
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* value = strchr(line, '\t');
+        if (line[0] == '#' || value == NULL) {
+            continue;
+        }
+        *value = '\0';
+        stats[line] = strtod(value + 1, NULL);
+    }
+    fclose(f);
+    return true;
+}
+
+// true if series is a series of the metric called name
+static bool is_series_of(const string& series, const string& name) {
+    return series.compare(0, name.size(), name) == 0 && (series.size() == name.size() || series[name.size()] == '{');
+}
+
+bool stats_has(const stats_t& stats, const string& name) {
+    for (auto& s : stats) {
+        if (is_series_of(s.first, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+double stats_sum(const stats_t& stats, const string& name) {
+    double sum = 0.0;
+    for (auto& s : stats) {
+        if (is_series_of(s.first, name)) {
+            sum += s.second;
+        }
+    }
+    return sum;
+}
+
+double stats_max(const stats_t& stats, const string& name) {
+    double max = 0.0;
+    for (auto& s : stats) {
+        if (is_series_of(s.first, name) && s.second > max) {
+            max = s.second;
+        }
+    }
+    return max;
+}
+
+static int remove_entry(const char* path, const struct stat*, int, struct FTW*) {
+    return remove(path);
+}
+
+void remove_tree(const string& path) {
+    nftw(path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
@@ -0,0 +1,69 @@
+/*
+ * harness.h
+ * Helpers shared by the soak and fault injection tests
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HARNESS_H
+#define _HARNESS_H
+
+#include <sys/types.h>  // pid_t
+#include <ctime>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// synthetic devices: U8 IQ files at HARNESS_SAMPLE_RATE centered on HARNESS_CENTERFREQ
+static const int HARNESS_SAMPLE_RATE = 48000;
+static const int HARNESS_CENTERFREQ = 100000000;
+
+double now_sec();
+std::string format_time(time_t t);
+
+// frequency of a synthetic channel relative to HARNESS_CENTERFREQ
+int channel_offset(int channel, int channel_count);
+
+// write a looped IQ file for a device with channel_count AM channels keying up and down
+bool generate_iq(const std::string& path, int device, int channel_count);
+
+// config file snippets
+std::string file_output_config(const std::string& dir, const std::string& name);
+std::string device_config(const std::string& iq_path, const std::vector<std::vector<std::string> >& channel_outputs);
+
+// Start boondock_airband in the foreground with extra environment variables, status output to /dev/null
+// and log messages to log_path. Returns the pid or -1.
+pid_t start_airband(const char* binary, const std::string& config_path, const std::string& log_path, const std::vector<std::pair<std::string, std::string> >& env);
+
+// SIGTERM the process and wait for it, false if it had to be killed or did not exit with 0
+bool stop_airband(pid_t pid);
+
+// true if the process has exited, status is set to its wait status
+bool airband_exited(pid_t pid, int* status);
+
+long read_rss_kb(pid_t pid);
+
+// Metrics from the stats file keyed by the full series name (name{labels}). False if the file is missing.
+typedef std::map<std::string, double> stats_t;
+bool read_stats(const std::string& path, stats_t& stats);
+bool stats_has(const stats_t& stats, const std::string& name);
+double stats_sum(const stats_t& stats, const std::string& name);
+double stats_max(const stats_t& stats, const std::string& name);
+
+void remove_tree(const std::string& path);
+
+#endif /* _HARNESS_H */
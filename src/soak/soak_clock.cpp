@@ -0,0 +1,144 @@
+/*
+ * soak_clock.cpp
+ * LD_PRELOAD shim running a process on an accelerated virtual clock
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ Wall clock and monotonic clock readings are replaced with a virtual clock running SOAK_CLOCK_SPEEDUP
+ times faster than the real one, starting at SOAK_CLOCK_START (seconds since the epoch, default: now).
+ Sleeps are shortened by the same factor, so anything paced with usleep() / nanosleep() (the file
+ input, the mixer, the status printer) runs accelerated as well while still seeing consistent time.
+ CPU time clocks are left alone.
+
+ sys/time.h is deliberately not included as the gettimeofday() prototype differs between libc versions,
+ struct timeval comes from sys/types.h instead.
+ */
+
+#include <dlfcn.h>      // dlsym()
+#include <sys/types.h>  // struct timeval
+#include <time.h>       // clock_gettime(), nanosleep()
+#include <unistd.h>     // usleep()
+#include <cstdint>
+#include <cstdlib>  // getenv(), strtod()
+
+typedef int (*clock_gettime_func_t)(clockid_t, struct timespec*);
+typedef int (*nanosleep_func_t)(const struct timespec*, struct timespec*);
+typedef int (*usleep_func_t)(useconds_t);
+
+static clock_gettime_func_t real_clock_gettime;
+static nanosleep_func_t real_nanosleep;
+static usleep_func_t real_usleep;
+
+static double speedup = 1.0;
+static int64_t real_start_ns;       // real monotonic time when the shim was loaded
+static int64_t virtual_start_ns;    // virtual wall clock time at that moment
+static int64_t monotonic_start_ns;  // virtual monotonic time at that moment (same as the real one)
+
+static int64_t to_ns(const struct timespec& ts) {
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static struct timespec from_ns(int64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ns / 1000000000LL);
+    ts.tv_nsec = (long)(ns % 1000000000LL);
+    return ts;
+}
+
+__attribute__((constructor)) static void soak_clock_init(void) {
+    real_clock_gettime = (clock_gettime_func_t)dlsym(RTLD_NEXT, "clock_gettime");
+    real_nanosleep = (nanosleep_func_t)dlsym(RTLD_NEXT, "nanosleep");
+    real_usleep = (usleep_func_t)dlsym(RTLD_NEXT, "usleep");
+
+    const char* env = getenv("SOAK_CLOCK_SPEEDUP");
+    if (env != NULL && strtod(env, NULL) > 0.0) {
+        speedup = strtod(env, NULL);
+    }
+
+    struct timespec ts;
+    real_clock_gettime(CLOCK_MONOTONIC, &ts);
+    real_start_ns = monotonic_start_ns = to_ns(ts);
+
+    env = getenv("SOAK_CLOCK_START");
+    if (env != NULL) {
+        virtual_start_ns = (int64_t)(strtod(env, NULL) * 1e9);
+    } else {
+        real_clock_gettime(CLOCK_REALTIME, &ts);
+        virtual_start_ns = to_ns(ts);
+    }
+}
+
+// virtual nanoseconds elapsed since the shim was loaded
+static int64_t virtual_elapsed_ns(void) {
+    struct timespec ts;
+    real_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)((double)(to_ns(ts) - real_start_ns) * speedup);
+}
+
+extern "C" {
+
+int clock_gettime(clockid_t clk_id, struct timespec* tp) __THROW {
+    switch (clk_id) {
+        case CLOCK_REALTIME:
+        case CLOCK_REALTIME_COARSE:
+            *tp = from_ns(virtual_start_ns + virtual_elapsed_ns());
+            return 0;
+        case CLOCK_MONOTONIC:
+        case CLOCK_MONOTONIC_COARSE:
+        case CLOCK_MONOTONIC_RAW:
+        case CLOCK_BOOTTIME:
+            *tp = from_ns(monotonic_start_ns + virtual_elapsed_ns());
+            return 0;
+        default:
+            return real_clock_gettime(clk_id, tp);
+    }
+}
+
+int gettimeofday(struct timeval* tv, void* /*tz*/) __THROW {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if (tv != NULL) {
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / 1000;
+    }
+    return 0;
+}
+
+time_t time(time_t* tloc) __THROW {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if (tloc != NULL) {
+        *tloc = ts.tv_sec;
+    }
+    return ts.tv_sec;
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+    struct timespec scaled = from_ns((int64_t)((double)to_ns(*req) / speedup));
+    int ret = real_nanosleep(&scaled, rem);
+    if (ret != 0 && rem != NULL) {
+        *rem = from_ns((int64_t)((double)to_ns(*rem) * speedup));
+    }
+    return ret;
+}
+
+int usleep(useconds_t usec) {
+    return real_usleep((useconds_t)((double)usec / speedup));
+}
+
+}  // extern "C"
@@ -0,0 +1,190 @@
+/*
+ * soak_standin.cpp
+ * Stand-in for boondock_airband to check the soak test harness itself
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ Accepts the command line soak_test starts boondock_airband with and behaves like a healthy instance as
+ far as the harness can tell: for every file output in the config it records hourly files of silent
+ MPEG 2.5 frames in step with the (virtual) clock, and it writes the stats file every 15 seconds.
+ That lets the RSS, overrun and recording checks and the trend report run end to end without a radio
+ build. Faults for the harness to catch are switched on with environment variables:
+
+ STANDIN_LEAK_KB_PER_HOUR   allocate and keep this much memory per simulated hour
+ STANDIN_OVERRUNS_PER_HOUR  report this many output overruns per simulated hour
+ STANDIN_SKIP_HOUR          do not record the n-th hour (counting from 0) of the run
+ */
+
+#include <signal.h>
+#include <sys/stat.h>  // mkdir()
+#include <sys/time.h>  // gettimeofday()
+#include <unistd.h>    // usleep(), getopt()
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// MPEG 2.5 layer III, 16 kbps, 8000 Hz, mono: 576 samples in 144 bytes
+static const unsigned char FRAME_HEADER[4] = {0xff, 0xe3, 0x28, 0xc4};
+static const size_t FRAME_BYTES = 144;
+static const double FRAME_SEC = 576.0 / 8000.0;
+static const double STATS_INTERVAL_SEC = 15.0;
+
+static volatile sig_atomic_t do_exit = 0;
+
+struct stream {
+    string path_prefix;  // directory/filename_template
+    FILE* f;
+    time_t hour;
+    double recorded_until;  // virtual time up to which frames have been written
+};
+
+static void on_signal(int) {
+    do_exit = 1;
+}
+
+static double virtual_now() {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static long env_long(const char* name, long def) {
+    const char* value = getenv(name);
+    return value != NULL ? atol(value) : def;
+}
+
+static string hour_path(const string& prefix, time_t hour) {
+    char suffix[32];
+    strftime(suffix, sizeof(suffix), "_%Y%m%d_%H.mp3", gmtime(&hour));
+    return prefix + suffix;
+}
+
+static void record(stream& s, double now, long skip_hour, time_t first_hour) {
+    static unsigned char frame[FRAME_BYTES];
+    memcpy(frame, FRAME_HEADER, sizeof(FRAME_HEADER));
+    while (s.recorded_until + FRAME_SEC <= now) {
+        time_t hour = (time_t)s.recorded_until - (time_t)s.recorded_until % 3600;
+        if (hour != s.hour || s.f == NULL) {
+            if (s.f != NULL) {
+                fclose(s.f);
+                s.f = NULL;
+            }
+            s.hour = hour;
+            if (skip_hour < 0 || hour != first_hour + skip_hour * 3600) {
+                s.f = fopen(hour_path(s.path_prefix, hour).c_str(), "a");
+            }
+        }
+        if (s.f != NULL) {
+            fwrite(frame, 1, sizeof(frame), s.f);
+        }
+        s.recorded_until += FRAME_SEC;
+    }
+}
+
+static void write_stats(const string& path, unsigned long overruns) {
+    FILE* f = fopen((path + ".tmp").c_str(), "w");
+    if (f == NULL) {
+        return;
+    }
+    fprintf(f, "buffer_overflow_count{device=\"0\"}\t0\n");
+    fprintf(f, "output_overrun_count{device=\"0\"}\t%lu\n", overruns);
+    fprintf(f, "input_overrun_count{mixer=\"0\",input=\"0\"}\t0\n");
+    fprintf(f, "demod_lag_seconds{device=\"0\"}\t0.000\n");
+    fclose(f);
+    rename((path + ".tmp").c_str(), path.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    const char* config_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "Fec:")) != -1) {
+        if (opt == 'c') {
+            config_path = optarg;
+        }
+    }
+    ifstream in(config_path != NULL ? config_path : "");
+    if (!in) {
+        fprintf(stderr, "Cannot read config file\n");
+        return 1;
+    }
+    stringstream config;
+    config << in.rdbuf();
+    string cfg = config.str();
+
+    string stats_path;
+    smatch m;
+    if (regex_search(cfg, m, regex("stats_filepath = \"([^\"]*)\""))) {
+        stats_path = m[1];
+    }
+    vector<stream> streams;
+    double start = virtual_now();
+    regex output("directory = \"([^\"]*)\"; filename_template = \"([^\"]*)\"");
+    for (sregex_iterator it(cfg.begin(), cfg.end(), output), end; it != end; ++it) {
+        mkdir((*it)[1].str().c_str(), 0755);
+        streams.push_back({(*it)[1].str() + "/" + (*it)[2].str(), NULL, 0, start});
+    }
+    fprintf(stderr, "soak stand-in: %zu file outputs, stats file %s\n", streams.size(), stats_path.c_str());
+
+    signal(SIGTERM, on_signal);
+    signal(SIGINT, on_signal);
+
+    long leak_kb_per_hour = env_long("STANDIN_LEAK_KB_PER_HOUR", 0);
+    long overruns_per_hour = env_long("STANDIN_OVERRUNS_PER_HOUR", 0);
+    long skip_hour = env_long("STANDIN_SKIP_HOUR", -1);
+    time_t first_hour = (time_t)start - (time_t)start % 3600;
+
+    vector<char*> leaked;
+    double leaked_kb = 0.0;
+    double next_stats = start;
+    while (!do_exit) {
+        usleep(125000);  // one batch
+        double now = virtual_now();
+        double hours = (now - start) / 3600.0;
+        for (auto& s : streams) {
+            record(s, now, skip_hour, first_hour);
+        }
+        while (leaked_kb < hours * leak_kb_per_hour) {
+            char* block = (char*)malloc(1024);
+            memset(block, 1, 1024);  // touch it so that it counts in RSS
+            leaked.push_back(block);
+            leaked_kb += 1.0;
+        }
+        if (!stats_path.empty() && now >= next_stats) {
+            write_stats(stats_path, (unsigned long)(hours * overruns_per_hour));
+            next_stats += STATS_INTERVAL_SEC;
+        }
+    }
+
+    for (auto& s : streams) {
+        if (s.f != NULL) {
+            fclose(s.f);
+        }
+    }
+    for (auto block : leaked) {
+        free(block);
+    }
+    return 0;
+}
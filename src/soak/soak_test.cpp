@@ -0,0 +1,493 @@
+/*
+ * soak_test.cpp
+ * Accelerated soak test for boondock_airband
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ Runs the real boondock_airband binary against synthetic IQ files on a virtual clock (see soak_clock.cpp)
+ so that days of operation pass in minutes. Each device gets a looped U8 IQ file with a few AM channels
+ keying up and down, every channel is recorded to a continuous file output and channel 0 of every
+ device is also fed to a mixer which is recorded as well.
+
+ While the test runs, RSS of the process and the overflow / overrun counters from the stats file are
+ sampled. Afterwards the recordings are checked: there must be exactly one file per stream for every
+ simulated hour and every full hour must hold an hour of audio. A trend report is printed and the
+ exit code is 0 when all checks passed, 1 when some failed and 2 when the test could not be run.
+ */
+
+#include <dirent.h>    // opendir(), readdir()
+#include <getopt.h>    // getopt()
+#include <sys/stat.h>  // mkdir()
+#include <unistd.h>    // usleep()
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "harness.h"
+
+using namespace std;
+
+static const int MAX_DEVICES = 8;
+static const int MAX_CHANNELS = 8;
+
+struct soak_params {
+    const char* binary = NULL;
+    const char* shim = NULL;
+    string workdir;
+    int devices = 2;
+    int channels = 2;
+    double hours = 26.0;
+    double speedup = 60.0;
+    time_t start = 1767311400;  // 2026-01-01 23:50:00 UTC, so that hour, day and year boundaries are crossed early
+    double sample_interval = 1.0;
+    long max_rss_growth_kb = 4096;
+    unsigned long max_overruns = 0;
+    double duration_tolerance = 0.01;
+    bool keep = false;
+};
+
+struct soak_sample {
+    double virtual_sec;  // since the start of the test
+    long rss_kb;
+    unsigned long overflows;        // buffer_overflow_count, all devices
+    unsigned long output_overruns;  // output_overrun_count, all devices and mixers
+    unsigned long input_overruns;   // input_overrun_count, all mixer inputs
+    double demod_lag;               // demod_lag_seconds, worst device
+};
+
+struct recording {
+    time_t hour;
+    double duration;
+};
+
+static bool write_config(const soak_params& params, const string& path) {
+    string rec = params.workdir + "/rec";
+    string cfg;
+    cfg += "fft_size = 256;\n";
+    cfg += "localtime = false;\n";
+    cfg += "stats_filepath = \"" + params.workdir + "/stats.txt\";\n";
+    cfg += "mixers: {\n  soakmix: {\n    outputs: ( " + file_output_config(rec, "mixer") + " );\n  };\n};\n";
+    cfg += "devices: (\n";
+    for (int d = 0; d < params.devices; d++) {
+        vector<vector<string> > channel_outputs(params.channels);
+        for (int c = 0; c < params.channels; c++) {
+            char name[32];
+            snprintf(name, sizeof(name), "dev%d_ch%d", d, c);
+            channel_outputs[c].push_back(file_output_config(rec, name));
+        }
+        channel_outputs[0].push_back("{ type = \"mixer\"; name = \"soakmix\"; }");
+        char iq_path[32];
+        snprintf(iq_path, sizeof(iq_path), "/dev%d.iq", d);
+        cfg += device_config(params.workdir + iq_path, channel_outputs);
+        cfg += (d < params.devices - 1) ? ",\n" : "\n";
+    }
+    cfg += ");\n";
+
+    FILE* f = fopen(path.c_str(), "w");
+    if (f == NULL || fwrite(cfg.data(), 1, cfg.size(), f) != cfg.size()) {
+        fprintf(stderr, "Cannot write %s: %s\n", path.c_str(), strerror(errno));
+        if (f != NULL) {
+            fclose(f);
+        }
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+// audio duration of an MP3 file in seconds, counting MPEG audio layer III frames
+static double mp3_duration(const string& path) {
+    static const int bitrates[2][15] = {
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},  // MPEG 1
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},     // MPEG 2 and 2.5
+    };
+    static const int samplerates[3][3] = {
+        {44100, 48000, 32000},  // MPEG 1
+        {22050, 24000, 16000},  // MPEG 2
+        {11025, 12000, 8000},   // MPEG 2.5
+    };
+
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == NULL) {
+        return -1.0;
+    }
+    vector<unsigned char> data;
+    unsigned char buf[65536];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + len);
+    }
+    fclose(f);
+
+    size_t pos = 0;
+    if (data.size() >= 10 && memcmp(data.data(), "ID3", 3) == 0) {
+        pos = 10 + ((data[6] & 0x7f) << 21 | (data[7] & 0x7f) << 14 | (data[8] & 0x7f) << 7 | (data[9] & 0x7f));
+    }
+
+    double duration = 0.0;
+    while (pos + 4 <= data.size()) {
+        const unsigned char* h = data.data() + pos;
+        int version = (h[1] >> 3) & 3;  // 0: MPEG 2.5, 2: MPEG 2, 3: MPEG 1
+        int layer = (h[1] >> 1) & 3;    // 1: layer III
+        int bitrate_idx = h[2] >> 4;
+        int samplerate_idx = (h[2] >> 2) & 3;
+        if (h[0] != 0xff || (h[1] & 0xe0) != 0xe0 || version == 1 || layer != 1 || bitrate_idx == 0 || bitrate_idx == 15 || samplerate_idx == 3) {
+            pos++;
+            continue;
+        }
+        bool mpeg1 = (version == 3);
+        int bitrate = bitrates[mpeg1 ? 0 : 1][bitrate_idx] * 1000;
+        int samplerate = samplerates[mpeg1 ? 0 : (version == 2 ? 1 : 2)][samplerate_idx];
+        int samples = mpeg1 ? 1152 : 576;
+        size_t frame_len = (size_t)(samples / 8 * bitrate / samplerate + ((h[2] >> 1) & 1));
+        duration += (double)samples / samplerate;
+        pos += frame_len;
+    }
+    return duration;
+}
+
+// recordings per stream (filename_template), keyed by the hour in the file name
+static bool scan_recordings(const string& dir, map<string, vector<recording> >& streams) {
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", dir.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        string name = de->d_name;
+        if (name[0] == '.') {
+            continue;
+        }
+        // <template>_YYYYMMDD_HH.mp3
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        size_t suffix_len = strlen("_YYYYMMDD_HH.mp3");
+        if (name.size() <= suffix_len || name.compare(name.size() - 4, 4, ".mp3") != 0 ||
+            sscanf(name.c_str() + name.size() - suffix_len, "_%4d%2d%2d_%2d.mp3", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour) != 4) {
+            fprintf(stderr, "FAIL: unexpected file %s/%s\n", dir.c_str(), name.c_str());
+            ok = false;
+            continue;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        recording r;
+        r.hour = timegm(&tm);
+        r.duration = mp3_duration(dir + "/" + name);
+        streams[name.substr(0, name.size() - suffix_len)].push_back(r);
+    }
+    closedir(d);
+    return ok;
+}
+
+static bool check_recordings(const soak_params& params, time_t virtual_end) {
+    map<string, vector<recording> > streams;
+    bool ok = scan_recordings(params.workdir + "/rec", streams);
+
+    size_t expected_streams = (size_t)(params.devices * params.channels + 1);
+    if (streams.size() != expected_streams) {
+        fprintf(stderr, "FAIL: %zu recorded streams, expected %zu\n", streams.size(), expected_streams);
+        ok = false;
+    }
+
+    time_t first_hour = params.start - params.start % 3600;
+    time_t last_hour = virtual_end - virtual_end % 3600;
+    printf("\nRecordings (full hours must hold 3600 s +/- %.1f%%):\n", params.duration_tolerance * 100.0);
+    for (auto& s : streams) {
+        vector<recording>& recs = s.second;
+        map<time_t, double> by_hour;
+        for (auto& r : recs) {
+            by_hour[r.hour] = r.duration;
+        }
+        printf("  %-12s", s.first.c_str());
+        double min_full = 1e9, max_full = 0.0;
+        for (time_t hour = first_hour; hour <= last_hour; hour += 3600) {
+            if (by_hour.count(hour) == 0) {
+                // the last hour may legitimately be missing if the test stopped right at the boundary
+                if (hour != last_hour || virtual_end - last_hour > 60) {
+                    fprintf(stderr, "FAIL: %s: no recording for %s\n", s.first.c_str(), format_time(hour).c_str());
+                    ok = false;
+                }
+                continue;
+            }
+            if (hour == first_hour || hour == last_hour) {
+                continue;
+            }
+            double d = by_hour[hour];
+            min_full = fmin(min_full, d);
+            max_full = fmax(max_full, d);
+            if (fabs(d - 3600.0) > 3600.0 * params.duration_tolerance) {
+                fprintf(stderr, "FAIL: %s: recording for %s holds %.1f s of audio\n", s.first.c_str(), format_time(hour).c_str(), d);
+                ok = false;
+            }
+        }
+        if (by_hour.size() != recs.size() || by_hour.begin()->first < first_hour || by_hour.rbegin()->first > last_hour) {
+            fprintf(stderr, "FAIL: %s: recordings outside of the test period\n", s.first.c_str());
+            ok = false;
+        }
+        if (max_full > 0.0) {
+            printf(" %zu files, full hours %.1f .. %.1f s\n", recs.size(), min_full, max_full);
+        } else {
+            printf(" %zu files, no full hours\n", recs.size());
+        }
+    }
+    return ok;
+}
+
+// least squares slope of y over x
+static double slope(const vector<double>& x, const vector<double>& y) {
+    double n = (double)x.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = 0; i < x.size(); i++) {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+    }
+    double denom = n * sxx - sx * sx;
+    return denom != 0.0 ? (n * sxy - sx * sy) / denom : 0.0;
+}
+
+static bool check_samples(const soak_params& params, const vector<soak_sample>& samples) {
+    bool ok = true;
+
+    // skip the first simulated hour (or first 10% of the run) while buffers and allocations settle
+    double warmup = fmin(3600.0, params.hours * 3600.0 * 0.1);
+    vector<double> x, rss;
+    for (auto& s : samples) {
+        if (s.virtual_sec >= warmup && s.rss_kb > 0) {
+            x.push_back(s.virtual_sec / 3600.0);
+            rss.push_back((double)s.rss_kb);
+        }
+    }
+
+    printf("\nTrend:\n");
+    if (rss.size() >= 8) {
+        size_t quarter = rss.size() / 4;
+        double head = 0.0, tail = 0.0;
+        for (size_t i = 0; i < quarter; i++) {
+            head += rss[i];
+            tail += rss[rss.size() - 1 - i];
+        }
+        head /= quarter;
+        tail /= quarter;
+        printf("  RSS: %.0f kB after warmup, %.0f kB at the end, slope %.1f kB per simulated hour\n", head, tail, slope(x, rss));
+        if (tail - head > params.max_rss_growth_kb) {
+            fprintf(stderr, "FAIL: RSS grew by %.0f kB (limit %ld kB)\n", tail - head, params.max_rss_growth_kb);
+            ok = false;
+        }
+    } else {
+        fprintf(stderr, "FAIL: not enough RSS samples after warmup (%zu)\n", rss.size());
+        ok = false;
+    }
+
+    if (samples.empty()) {
+        return false;
+    }
+    const soak_sample& last = samples.back();
+    double hours = last.virtual_sec / 3600.0;
+    printf("  buffer overflows: %lu (%.2f per simulated hour)\n", last.overflows, last.overflows / hours);
+    printf("  output overruns:  %lu (%.2f per simulated hour)\n", last.output_overruns, last.output_overruns / hours);
+    printf("  mixer input overruns: %lu (%.2f per simulated hour)\n", last.input_overruns, last.input_overruns / hours);
+    double max_lag = 0.0;
+    for (auto& s : samples) {
+        max_lag = fmax(max_lag, s.demod_lag);
+    }
+    printf("  demod lag: %.3f s at the end, %.3f s at most\n", last.demod_lag, max_lag);
+    unsigned long total = last.overflows + last.output_overruns + last.input_overruns;
+    if (total > params.max_overruns) {
+        fprintf(stderr, "FAIL: %lu overflows / overruns (limit %lu)%s\n", total, params.max_overruns,
+                last.overflows > 0 ? ", buffer overflows usually mean the speedup is too high for this machine" : "");
+        ok = false;
+    }
+    return ok;
+}
+
+static void usage(const char* argv0) {
+    soak_params defaults;
+    printf(
+        "Usage: %s -b <boondock_airband> -l <libsoak_clock.so> [options]\n"
+        "\t-w <dir>\tWork directory (default: a new directory in /tmp, removed after a successful run)\n"
+        "\t-d <count>\tNumber of devices (default: %d)\n"
+        "\t-c <count>\tNumber of channels per device (default: %d)\n"
+        "\t-H <hours>\tSimulated duration in hours (default: %.0f)\n"
+        "\t-s <factor>\tClock speedup (default: %.0f)\n"
+        "\t-t <time>\tSimulated start time in seconds since the epoch (default: %ld)\n"
+        "\t-i <sec>\tSampling interval in real seconds (default: %.1f)\n"
+        "\t-r <kB>\t\tMaximum RSS growth after warmup (default: %ld)\n"
+        "\t-o <count>\tMaximum number of overflows / overruns (default: %lu)\n"
+        "\t-T <fraction>\tAudio duration tolerance for full hour files (default: %.2f)\n"
+        "\t-k\t\tKeep the work directory\n",
+        argv0, defaults.devices, defaults.channels, defaults.hours, defaults.speedup, (long)defaults.start, defaults.sample_interval, defaults.max_rss_growth_kb, defaults.max_overruns,
+        defaults.duration_tolerance);
+}
+
+int main(int argc, char* argv[]) {
+    soak_params params;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:l:w:d:c:H:s:t:i:r:o:T:kh")) != -1) {
+        switch (opt) {
+            case 'b':
+                params.binary = optarg;
+                break;
+            case 'l':
+                params.shim = optarg;
+                break;
+            case 'w':
+                params.workdir = optarg;
+                break;
+            case 'd':
+                params.devices = atoi(optarg);
+                break;
+            case 'c':
+                params.channels = atoi(optarg);
+                break;
+            case 'H':
+                params.hours = atof(optarg);
+                break;
+            case 's':
+                params.speedup = atof(optarg);
+                break;
+            case 't':
+                params.start = (time_t)atol(optarg);
+                break;
+            case 'i':
+                params.sample_interval = atof(optarg);
+                break;
+            case 'r':
+                params.max_rss_growth_kb = atol(optarg);
+                break;
+            case 'o':
+                params.max_overruns = strtoul(optarg, NULL, 10);
+                break;
+            case 'T':
+                params.duration_tolerance = atof(optarg);
+                break;
+            case 'k':
+                params.keep = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (params.binary == NULL || params.shim == NULL || params.devices < 1 || params.devices > MAX_DEVICES || params.channels < 1 || params.channels > MAX_CHANNELS || params.hours <= 0.0 ||
+        params.speedup < 1.0 || params.sample_interval <= 0.0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    bool own_workdir = params.workdir.empty();
+    if (own_workdir) {
+        char tmpl[] = "/tmp/boondock_soak.XXXXXX";
+        if (mkdtemp(tmpl) == NULL) {
+            fprintf(stderr, "Cannot create work directory: %s\n", strerror(errno));
+            return 2;
+        }
+        params.workdir = tmpl;
+    } else {
+        mkdir(params.workdir.c_str(), 0755);
+    }
+    mkdir((params.workdir + "/rec").c_str(), 0755);
+
+    printf("Soak test: %d device(s) x %d channel(s) + mixer, %.1f simulated hours from %s UTC at %.0fx, work directory %s\n", params.devices, params.channels, params.hours,
+           format_time(params.start).c_str(), params.speedup, params.workdir.c_str());
+
+    for (int d = 0; d < params.devices; d++) {
+        char path[32];
+        snprintf(path, sizeof(path), "/dev%d.iq", d);
+        if (!generate_iq(params.workdir + path, d, params.channels)) {
+            return 2;
+        }
+    }
+    string config_path = params.workdir + "/soak.conf";
+    if (!write_config(params, config_path)) {
+        return 2;
+    }
+
+    double real_start = now_sec();
+    char speedup[32], start[32];
+    snprintf(speedup, sizeof(speedup), "%f", params.speedup);
+    snprintf(start, sizeof(start), "%ld", (long)params.start);
+    vector<pair<string, string> > env = {{"LD_PRELOAD", params.shim}, {"SOAK_CLOCK_SPEEDUP", speedup}, {"SOAK_CLOCK_START", start}};
+    pid_t pid = start_airband(params.binary, config_path, params.workdir + "/boondock_airband.log", env);
+    if (pid < 0) {
+        fprintf(stderr, "Cannot fork: %s\n", strerror(errno));
+        return 2;
+    }
+
+    bool ok = true;
+    vector<soak_sample> samples;
+    double virtual_sec = 0.0;
+    double next_report = 0.0;
+    while (virtual_sec < params.hours * 3600.0) {
+        usleep((useconds_t)(params.sample_interval * 1e6));
+        int status;
+        if (airband_exited(pid, &status)) {
+            fprintf(stderr, "FAIL: boondock_airband exited prematurely (status %d), see %s/boondock_airband.log\n", status, params.workdir.c_str());
+            ok = false;
+            pid = -1;
+            break;
+        }
+
+        virtual_sec = (now_sec() - real_start) * params.speedup;
+        // demod_lag_seconds is written after the counters, skip files that are missing or still being written
+        stats_t stats;
+        if (!read_stats(params.workdir + "/stats.txt", stats) || !stats_has(stats, "demod_lag_seconds")) {
+            continue;
+        }
+        soak_sample sample;
+        sample.virtual_sec = virtual_sec;
+        sample.rss_kb = read_rss_kb(pid);
+        sample.overflows = (unsigned long)stats_sum(stats, "buffer_overflow_count");
+        sample.output_overruns = (unsigned long)stats_sum(stats, "output_overrun_count");
+        sample.input_overruns = (unsigned long)stats_sum(stats, "input_overrun_count");
+        sample.demod_lag = stats_max(stats, "demod_lag_seconds");
+        samples.push_back(sample);
+
+        if (virtual_sec >= next_report) {
+            printf("  %s  RSS %6ld kB  overflows %lu  output overruns %lu  mixer input overruns %lu\n", format_time(params.start + (time_t)virtual_sec).c_str(), sample.rss_kb,
+                   sample.overflows, sample.output_overruns, sample.input_overruns);
+            fflush(stdout);
+            next_report += 3600.0;
+        }
+    }
+
+    time_t virtual_end = params.start + (time_t)((now_sec() - real_start) * params.speedup);
+    if (pid > 0 && !stop_airband(pid)) {
+        fprintf(stderr, "FAIL: boondock_airband did not shut down cleanly\n");
+        ok = false;
+    }
+
+    ok = check_samples(params, samples) && ok;
+    ok = check_recordings(params, virtual_end) && ok;
+
+    printf("\nSoak test %s\n", ok ? "PASSED" : "FAILED");
+    if (ok && own_workdir && !params.keep) {
+        remove_tree(params.workdir);
+    } else {
+        printf("Work directory kept: %s\n", params.workdir.c_str());
+    }
+    return ok ? 0 : 1;
+}
@@ -24,8 +24,7 @@
 #include <string.h>  // strerror()
 #endif               /* DEBUG_SQUELCH _*/
 
-#include <stdlib.h>   // calloc()
-#include <algorithm>  // min()
+#include <algorithm>  // min(), fill()
 #include <cassert>    // assert()
 #include <cmath>      // pow()
 
@@ -64,10 +63,10 @@ Squelch::Squelch(void) {
     recent_open_count_ = 0;
     closed_sample_count_ = 0;
 
-    buffer_size_ = 102;  // NOTE: this is specific to the 2nd order lowpass Bessel filter
+    buffer_size_ = BUFFER_SIZE;
     buffer_head_ = 0;
     buffer_tail_ = 1;
-    buffer_ = (float*)calloc(buffer_size_, sizeof(float));
+    fill(buffer_, buffer_ + BUFFER_SIZE, 0.0f);
 
 #ifdef DEBUG_SQUELCH
     debug_file_ = NULL;
@@ -149,10 +149,11 @@ class Squelch {
     size_t closed_sample_count_;   // number of continuous samples where squelch has been CLOSED
 
     // Buffered pre-filtered values
-    int buffer_size_;  // size of buffer
-    int buffer_head_;  // index to add new values
-    int buffer_tail_;  // index to read buffered values
-    float* buffer_;    // buffer
+    static const int BUFFER_SIZE = 102;  // NOTE: this is specific to the 2nd order lowpass Bessel filter
+    int buffer_size_;                    // size of buffer
+    int buffer_head_;                    // index to add new values
+    int buffer_tail_;                    // index to read buffered values
+    float buffer_[BUFFER_SIZE];          // buffer
 
     CTCSS ctcss_fast_;  // ctcss tone detection
     CTCSS ctcss_slow_;  // ctcss tone detection
@@ -153,3 +153,12 @@ TEST_F(CTCSSTest, has_each_standard_tone) {
         test_all_tones(signal, tone);
     }
 }
+
+TEST(ToneDetectorSetTest, add_when_full) {
+    ToneDetectorSet tones;
+    for (int i = 0; i < ToneDetectorSet::MAX_TONES; ++i) {
+        EXPECT_TRUE(tones.add(100.0 + i, 8000.0, 8000));
+    }
+    EXPECT_FALSE(tones.add(200.0, 8000.0, 8000));
+    EXPECT_EQ(tones.size(), ToneDetectorSet::MAX_TONES);
+}
@@ -0,0 +1,101 @@
+/*
+ * test_dsp_arena.cpp
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test_base_class.h"
+
+#include <cstdint>  // uintptr_t
+
+#include "dsp_arena.h"
+
+using namespace std;
+
+class DspArenaTest : public TestBaseClass {
+   protected:
+    void SetUp(void) { TestBaseClass::SetUp(); }
+
+    void TearDown(void) { TestBaseClass::TearDown(); }
+
+    // the same sequence of takes for both passes, like the layout of a device
+    void layout(DspArena& arena, float** a, int** b, char** c) {
+        *a = arena.take_array<float>(10);
+        *b = arena.take_array<int>(100);
+        *c = arena.take_array<char>(1);
+    }
+};
+
+TEST_F(DspArenaTest, measure_only) {
+    DspArena arena;
+    float* a;
+    int* b;
+    char* c;
+    layout(arena, &a, &b, &c);
+
+    EXPECT_TRUE(a == NULL);
+    EXPECT_TRUE(b == NULL);
+    EXPECT_TRUE(c == NULL);
+    EXPECT_FALSE(arena.committed());
+    EXPECT_EQ(arena.size(), 64 + 448 + 64);
+    EXPECT_EQ(arena.used(), 0);
+}
+
+TEST_F(DspArenaTest, consecutive_aligned_pieces) {
+    DspArena arena;
+    float* a;
+    int* b;
+    char* c;
+    layout(arena, &a, &b, &c);
+    ASSERT_TRUE(arena.commit());
+    layout(arena, &a, &b, &c);
+
+    ASSERT_TRUE(a != NULL);
+    EXPECT_EQ((uintptr_t)a % DspArena::ALIGNMENT, 0);
+    EXPECT_EQ((char*)b, (char*)a + 64);
+    EXPECT_EQ(c, (char*)b + 448);
+    EXPECT_EQ(arena.used(), arena.size());
+}
+
+TEST_F(DspArenaTest, zeroed) {
+    DspArena arena;
+    arena.take(1000);
+    ASSERT_TRUE(arena.commit());
+    unsigned char* p = (unsigned char*)arena.take(1000);
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(p[i], 0);
+    }
+}
+
+TEST_F(DspArenaTest, contains) {
+    DspArena arena;
+    int outside = 0;
+    arena.take(100);
+    EXPECT_FALSE(arena.contains(&outside));
+    ASSERT_TRUE(arena.commit());
+    char* p = (char*)arena.take(100);
+    EXPECT_TRUE(arena.contains(p));
+    EXPECT_TRUE(arena.contains(p + 127));
+    EXPECT_FALSE(arena.contains(p + 128));
+    EXPECT_FALSE(arena.contains(&outside));
+}
+
+TEST_F(DspArenaTest, empty) {
+    DspArena arena;
+    ASSERT_TRUE(arena.commit());
+    EXPECT_TRUE(arena.committed());
+    EXPECT_EQ(arena.size(), 0);
+}
@@ -0,0 +1,175 @@
+/*
+ * test_replay_buffer.cpp
+ *
+ * Copyright (C) 2026 charlie-foxtrot
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test_base_class.h"
+
+#include "replay_buffer.h"
+
+using namespace std;
+
+class ReplayBufferTest : public TestBaseClass {
+   protected:
+    void SetUp(void) {
+        TestBaseClass::SetUp();
+        start.tv_sec = 1000;
+        start.tv_usec = 0;
+    }
+
+    void TearDown(void) { TestBaseClass::TearDown(); }
+
+    struct timeval at(double sec) {
+        struct timeval tv = start;
+        tv.tv_sec += (time_t)sec;
+        tv.tv_usec += (suseconds_t)((sec - (time_t)sec) * 1000000.0);
+        return tv;
+    }
+
+    // store a chunk of `len` bytes all set to `value`
+    void put(ReplayBuffer& buffer, unsigned char value, size_t len, double sec, bool transmission_start = false) {
+        vector<unsigned char> data(len, value);
+        buffer.put(data.data(), data.size(), at(sec), transmission_start);
+    }
+
+    struct timeval start;
+};
+
+TEST_F(ReplayBufferTest, empty_buffer) {
+    ReplayBuffer buffer(60, 10, 100);
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_seconds(at(0), 60, out), 0);
+    EXPECT_EQ(buffer.get_transmissions(at(0), 1, out), 0);
+    EXPECT_EQ(buffer.transmission_count(at(0)), 0);
+    EXPECT_EQ(buffer.bytes(), 0);
+}
+
+TEST_F(ReplayBufferTest, put_and_get) {
+    ReplayBuffer buffer(60, 10, 100);
+    put(buffer, 1, 5, 0);
+    put(buffer, 2, 5, 1);
+
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_seconds(at(1), 60, out), 10);
+    vector<unsigned char> expected = {1, 1, 1, 1, 1, 2, 2, 2, 2, 2};
+    EXPECT_EQ(out, expected);
+    EXPECT_EQ(buffer.bytes(), 10);
+}
+
+TEST_F(ReplayBufferTest, get_last_seconds) {
+    ReplayBuffer buffer(60, 10, 100);
+    put(buffer, 1, 5, 0);
+    put(buffer, 2, 5, 10);
+    put(buffer, 3, 5, 20);
+
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_seconds(at(25), 14, out), 5);
+    EXPECT_EQ(out[0], 3);
+}
+
+TEST_F(ReplayBufferTest, drop_oldest_when_bytes_full) {
+    ReplayBuffer buffer(60, 10, 12);
+    put(buffer, 1, 5, 0);
+    put(buffer, 2, 5, 1);
+    put(buffer, 3, 5, 2);
+
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_seconds(at(2), 60, out), 10);
+    vector<unsigned char> expected = {2, 2, 2, 2, 2, 3, 3, 3, 3, 3};
+    EXPECT_EQ(out, expected);
+}
+
+TEST_F(ReplayBufferTest, drop_oldest_when_chunks_full) {
+    ReplayBuffer buffer(60, 2, 100);
+    put(buffer, 1, 1, 0);
+    put(buffer, 2, 1, 1);
+    put(buffer, 3, 1, 2);
+
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_seconds(at(2), 60, out), 2);
+    vector<unsigned char> expected = {2, 3};
+    EXPECT_EQ(out, expected);
+}
+
+TEST_F(ReplayBufferTest, drop_oldest_when_too_old) {
+    ReplayBuffer buffer(60, 10, 100);
+    put(buffer, 1, 5, 0);
+    put(buffer, 2, 5, 61);
+    EXPECT_EQ(buffer.bytes(), 5);
+
+    // chunks older than the duration are not returned even if still stored
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_seconds(at(200), 60, out), 0);
+}
+
+TEST_F(ReplayBufferTest, wrap_around) {
+    ReplayBuffer buffer(60, 10, 8);
+    put(buffer, 1, 3, 0);
+    put(buffer, 2, 3, 1);
+    put(buffer, 3, 4, 2);  // drops first chunk and wraps
+
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_seconds(at(2), 60, out), 7);
+    vector<unsigned char> expected = {2, 2, 2, 3, 3, 3, 3};
+    EXPECT_EQ(out, expected);
+}
+
+TEST_F(ReplayBufferTest, oversized_chunk_ignored) {
+    ReplayBuffer buffer(60, 10, 8);
+    put(buffer, 1, 3, 0);
+    put(buffer, 2, 9, 1);
+    EXPECT_EQ(buffer.bytes(), 3);
+}
+
+TEST_F(ReplayBufferTest, get_transmissions) {
+    ReplayBuffer buffer(60, 10, 100);
+    put(buffer, 1, 2, 0, true);
+    put(buffer, 1, 2, 1);
+    put(buffer, 2, 2, 10, true);
+    put(buffer, 2, 2, 11);
+    put(buffer, 3, 2, 20, true);
+
+    EXPECT_EQ(buffer.transmission_count(at(20)), 3);
+
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_transmissions(at(20), 1, out), 2);
+    EXPECT_EQ(out[0], 3);
+
+    out.clear();
+    EXPECT_EQ(buffer.get_transmissions(at(20), 2, out), 6);
+    vector<unsigned char> expected = {2, 2, 2, 2, 3, 3};
+    EXPECT_EQ(out, expected);
+
+    // asking for more than available returns everything
+    out.clear();
+    EXPECT_EQ(buffer.get_transmissions(at(20), 5, out), 10);
+}
+
+TEST_F(ReplayBufferTest, holds_whole_duration) {
+    const int duration = 300;
+    const int batches_per_sec = 8;
+    ReplayBuffer buffer(duration, ReplayBuffer::chunks_for(duration, batches_per_sec), 1000000);
+    EXPECT_EQ(buffer.max_chunks(), 2401);
+
+    const int batches = duration * batches_per_sec;
+    for (int i = 0; i < batches; i++) {
+        put(buffer, 'a', 10, (double)i / batches_per_sec, i == 0);
+    }
+    vector<unsigned char> out;
+    EXPECT_EQ(buffer.get_seconds(at((double)(batches - 1) / batches_per_sec), 0, out), (size_t)batches * 10);
+    EXPECT_EQ(buffer.transmission_count(at((double)(batches - 1) / batches_per_sec)), 1);
+}